@@ -0,0 +1,553 @@
+#include "analyzer.h"
+
+#include <algorithm>
+
+#include "arena.h"
+#include "jit.h"
+#include "optimizer.h"
+
+std::shared_ptr<Node> Analyze(const Value& ast, std::shared_ptr<Scope> global, bool jit) {
+    return Analyzer(std::move(global), jit).AnalyzeExpression(ast);
+}
+
+ObjectList ListToVector(Value list, const std::string& error_message) {
+    ObjectList elements;
+    while (list) {
+        if (!Is<Cell>(list)) {
+            throw SyntaxError(error_message);
+        }
+        elements.push_back(As<Cell>(list)->GetFirst());
+        list = As<Cell>(list)->GetSecond();
+    }
+    return elements;
+}
+
+void CollectDefines(const Value& ast, std::vector<SymbolId>& names) {
+    if (!Is<Cell>(ast)) {
+        return;
+    }
+    auto form = GetSpecialForm(As<Cell>(ast)->GetFirst());
+    if (form == SpecialForm::kQuote || form == SpecialForm::kLambda) {
+        return;
+    }
+
+    auto tail = As<Cell>(ast)->GetSecond();
+    if (form == SpecialForm::kDefine && Is<Cell>(tail)) {
+        auto target = As<Cell>(tail)->GetFirst();
+        if (Is<Cell>(target)) {
+            // lambda syntax sugar, its body belongs to new frame
+            target = As<Cell>(target)->GetFirst();
+            tail = nullptr;
+        } else {
+            tail = As<Cell>(tail)->GetSecond();
+        }
+        if (Is<Symbol>(target)) {
+            auto name = As<Symbol>(target)->GetId();
+            if (std::find(names.begin(), names.end(), name) == names.end()) {
+                names.push_back(name);
+            }
+        }
+    }
+
+    while (Is<Cell>(tail)) {
+        CollectDefines(As<Cell>(tail)->GetFirst(), names);
+        tail = As<Cell>(tail)->GetSecond();
+    }
+}
+
+SpecialForm GetSpecialForm(const Value& head) {
+    static const SymbolId kQuote = InternSymbol("quote")->id;
+    static const SymbolId kIf = InternSymbol("if")->id;
+    static const SymbolId kDefine = InternSymbol("define")->id;
+    static const SymbolId kSet = InternSymbol("set!")->id;
+    static const SymbolId kLambda = InternSymbol("lambda")->id;
+    static const SymbolId kAnd = InternSymbol("and")->id;
+    static const SymbolId kOr = InternSymbol("or")->id;
+
+    if (!Is<Symbol>(head)) {
+        return SpecialForm::kNone;
+    }
+    auto id = As<Symbol>(head)->GetId();
+    if (id == kQuote) {
+        return SpecialForm::kQuote;
+    }
+    if (id == kIf) {
+        return SpecialForm::kIf;
+    }
+    if (id == kDefine) {
+        return SpecialForm::kDefine;
+    }
+    if (id == kSet) {
+        return SpecialForm::kSet;
+    }
+    if (id == kLambda) {
+        return SpecialForm::kLambda;
+    }
+    if (id == kAnd) {
+        return SpecialForm::kAnd;
+    }
+    if (id == kOr) {
+        return SpecialForm::kOr;
+    }
+    return SpecialForm::kNone;
+}
+
+void LexicalScope::PushFrame(Frame frame) {
+    frames_.push_back(std::move(frame));
+}
+
+void LexicalScope::PopFrame() {
+    frames_.pop_back();
+}
+
+bool LexicalScope::Resolve(SymbolId name, int32_t& depth, int32_t& slot) const {
+    for (size_t i = 0; i < frames_.size(); ++i) {
+        const auto& frame = frames_[frames_.size() - 1 - i];
+        auto it = std::find(frame.begin(), frame.end(), name);
+        if (it != frame.end()) {
+            depth = static_cast<int32_t>(i);
+            slot = static_cast<int32_t>(it - frame.begin());
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LexicalScope::IsToplevel() const {
+    return frames_.empty();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+Analyzer::Analyzer(std::shared_ptr<Scope> global, bool jit)
+    : global_(std::move(global)), jit_(jit) {
+}
+
+std::shared_ptr<Node> Analyzer::AnalyzeExpression(const Value& ast) {
+    if (!ast) {
+        throw RuntimeError("Invalid expression");
+    }
+    if (Is<Symbol>(ast)) {
+        auto name = As<Symbol>(ast)->GetId();
+        int32_t depth;
+        int32_t slot;
+        if (lexical_scope_.Resolve(name, depth, slot)) {
+            return std::make_shared<LocalRefNode>(depth, slot);
+        }
+        return std::make_shared<GlobalRefNode>(name, global_);
+    }
+    if (Is<FoldedCall>(ast)) {
+        // the tree of toplevel code is gone with the code, lambdas keep theirs
+        auto folded = lexical_scope_.IsToplevel() ? ast : Arena::Promote(ast);
+        return std::make_shared<FoldedCallNode>(folded,
+                                                AnalyzeExpression(As<FoldedCall>(ast)->GetCall()));
+    }
+    if (!Is<Cell>(ast)) {
+        return std::make_shared<ConstantNode>(ast);
+    }
+
+    auto form = ListToVector(ast, "Incorrect expression syntax");
+    if (!form.front()) {
+        throw RuntimeError("Expression should contain operator");
+    }
+
+    switch (GetSpecialForm(form.front())) {
+        case SpecialForm::kQuote:
+            return AnalyzeQuote(form);
+        case SpecialForm::kIf:
+            return AnalyzeIf(form);
+        case SpecialForm::kDefine:
+            return AnalyzeDefine(form);
+        case SpecialForm::kSet:
+            return AnalyzeSet(form);
+        case SpecialForm::kLambda:
+            if (form.size() < 2) {
+                throw SyntaxError("Lambda should have args");
+            }
+            return AnalyzeLambda(form[1], form, 2);
+        case SpecialForm::kAnd:
+            return std::make_shared<AndNode>(AnalyzeList(form, 1));
+        case SpecialForm::kOr:
+            return std::make_shared<OrNode>(AnalyzeList(form, 1));
+        case SpecialForm::kNone:
+            break;
+    }
+
+    return std::make_shared<CallNode>(AnalyzeExpression(form.front()), AnalyzeList(form, 1));
+}
+
+NodeList Analyzer::AnalyzeList(const ObjectList& list, size_t start_ind) {
+    NodeList nodes;
+    for (size_t i = start_ind; i < list.size(); ++i) {
+        nodes.push_back(AnalyzeExpression(list[i]));
+    }
+    return nodes;
+}
+
+std::shared_ptr<Node> Analyzer::AnalyzeQuote(const ObjectList& form) {
+    if (form.size() != 2) {
+        throw SyntaxError("Incorrect 'quote' syntax");
+    }
+    return std::make_shared<ConstantNode>(form[1]);
+}
+
+std::shared_ptr<Node> Analyzer::AnalyzeIf(const ObjectList& form) {
+    if (form.size() != 3 && form.size() != 4) {
+        throw SyntaxError("Incorrect 'if' syntax");
+    }
+    auto condition = AnalyzeExpression(form[1]);
+    auto true_branch = AnalyzeExpression(form[2]);
+    std::shared_ptr<Node> false_branch;
+    if (form.size() == 4) {
+        false_branch = AnalyzeExpression(form[3]);
+    }
+    return std::make_shared<IfNode>(condition, true_branch, false_branch);
+}
+
+std::shared_ptr<Node> Analyzer::AnalyzeDefine(const ObjectList& form) {
+    if (form.size() < 3) {
+        throw SyntaxError("Incorrect 'define/set' syntax");
+    }
+
+    // lambda syntax sugar: (define (name args...) body...)
+    if (Is<Cell>(form[1])) {
+        auto name = As<Cell>(form[1])->GetFirst();
+        if (!Is<Symbol>(name)) {
+            throw SyntaxError("Name of variable should be a symbol");
+        }
+        return AnalyzeVariableStore(As<Symbol>(name)->GetId(),
+                                    AnalyzeLambda(As<Cell>(form[1])->GetSecond(), form, 2), true);
+    }
+
+    if (!Is<Symbol>(form[1])) {
+        throw SyntaxError("Name of variable should be a symbol");
+    }
+    if (form.size() != 3) {
+        throw SyntaxError("Incorrect 'define/set' syntax");
+    }
+    return AnalyzeVariableStore(As<Symbol>(form[1])->GetId(), AnalyzeExpression(form[2]), true);
+}
+
+std::shared_ptr<Node> Analyzer::AnalyzeSet(const ObjectList& form) {
+    if (form.size() != 3 || !Is<Symbol>(form[1])) {
+        throw SyntaxError("Incorrect 'define/set' syntax");
+    }
+    return AnalyzeVariableStore(As<Symbol>(form[1])->GetId(), AnalyzeExpression(form[2]), false);
+}
+
+std::shared_ptr<Node> Analyzer::AnalyzeVariableStore(SymbolId name, std::shared_ptr<Node> value,
+                                                     bool is_define) {
+    int32_t depth;
+    int32_t slot;
+    if (lexical_scope_.Resolve(name, depth, slot)) {
+        return std::make_shared<LocalStoreNode>(depth, slot, std::move(value));
+    }
+    if (is_define) {
+        return std::make_shared<GlobalDefineNode>(name, std::move(value), global_);
+    }
+    return std::make_shared<GlobalSetNode>(name, std::move(value), global_);
+}
+
+std::shared_ptr<Node> Analyzer::AnalyzeLambda(const Value& arg_list, const ObjectList& body,
+                                              size_t body_start_ind) {
+    LexicalScope::Frame frame;
+    for (const auto& arg : ListToVector(arg_list, "Wrong lambda args syntax")) {
+        if (!Is<Symbol>(arg)) {
+            throw SyntaxError("Lambda args should be Symbol type");
+        }
+        frame.push_back(As<Symbol>(arg)->GetId());
+    }
+    if (body_start_ind >= body.size()) {
+        throw SyntaxError("Lambda should have body");
+    }
+
+    size_t arg_count = frame.size();
+    for (size_t i = body_start_ind; i < body.size(); ++i) {
+        CollectDefines(body[i], frame);
+    }
+    size_t local_count = frame.size();
+
+    std::shared_ptr<JitProfile> jit_profile;
+    if (jit_ && lexical_scope_.IsToplevel()) {
+        // native code refers to nothing but arguments and globals
+        jit_profile = std::make_shared<JitProfile>(
+            LexicalScope::Frame(frame.begin(), frame.begin() + arg_count),
+            ObjectList(body.begin() + body_start_ind, body.end()), global_);
+    }
+
+    lexical_scope_.PushFrame(std::move(frame));
+    auto body_nodes = AnalyzeList(body, body_start_ind);
+    lexical_scope_.PopFrame();
+    return std::make_shared<LambdaNode>(arg_count, local_count, std::move(body_nodes),
+                                        std::move(jit_profile));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// constants escape through execution, e.g. a quoted list stored by 'define'
+ConstantNode::ConstantNode(Value value) : value_(Arena::Promote(value)) {
+}
+
+Value ConstantNode::Execute(const Ref<Environment>&) {
+    return value_;
+}
+
+LocalRefNode::LocalRefNode(int32_t depth, int32_t slot) : depth_(depth), slot_(slot) {
+}
+
+Value LocalRefNode::Execute(const Ref<Environment>& env) {
+    const auto& value = env->Slot(depth_, slot_);
+    if (value.IsUnbound()) {
+        throw NameError("Variable is used before definition");
+    }
+    return value;
+}
+
+GlobalRefNode::GlobalRefNode(SymbolId name, std::shared_ptr<Scope> global)
+    : binding_(global->GetBinding(name)), global_(std::move(global)) {
+}
+
+Value GlobalRefNode::Execute(const Ref<Environment>&) {
+    return binding_->Get();
+}
+
+FoldedCallNode::FoldedCallNode(Value folded, std::shared_ptr<Node> call)
+    : folded_(std::move(folded)), call_(std::move(call)) {
+}
+
+Value FoldedCallNode::Execute(const Ref<Environment>& env) {
+    auto folded = static_cast<FoldedCall*>(folded_.GetObject());
+    if (folded->IsValid()) {
+        return folded->GetValue();
+    }
+    return call_->Execute(env);
+}
+
+Value FoldedCallNode::ExecuteTail(const Ref<Environment>& env, TailCall& tail) {
+    auto folded = static_cast<FoldedCall*>(folded_.GetObject());
+    if (folded->IsValid()) {
+        return folded->GetValue();
+    }
+    return call_->ExecuteTail(env, tail);
+}
+
+IfNode::IfNode(std::shared_ptr<Node> condition, std::shared_ptr<Node> true_branch,
+               std::shared_ptr<Node> false_branch)
+    : condition_(std::move(condition)),
+      true_branch_(std::move(true_branch)),
+      false_branch_(std::move(false_branch)) {
+}
+
+Value IfNode::Execute(const Ref<Environment>& env) {
+    if (IsTrue(condition_->Execute(env))) {
+        return true_branch_->Execute(env);
+    }
+    if (!false_branch_) {
+        return Value();
+    }
+    return false_branch_->Execute(env);
+}
+
+Value IfNode::ExecuteTail(const Ref<Environment>& env, TailCall& tail) {
+    if (IsTrue(condition_->Execute(env))) {
+        return true_branch_->ExecuteTail(env, tail);
+    }
+    if (!false_branch_) {
+        return Value();
+    }
+    return false_branch_->ExecuteTail(env, tail);
+}
+
+LocalStoreNode::LocalStoreNode(int32_t depth, int32_t slot, std::shared_ptr<Node> value)
+    : depth_(depth), slot_(slot), value_(std::move(value)) {
+}
+
+Value LocalStoreNode::Execute(const Ref<Environment>& env) {
+    auto value = value_->Execute(env);
+    env->Slot(depth_, slot_) = std::move(value);
+    return Value();
+}
+
+GlobalDefineNode::GlobalDefineNode(SymbolId name, std::shared_ptr<Node> value,
+                                   std::shared_ptr<Scope> global)
+    : binding_(global->GetBinding(name)), value_(std::move(value)), global_(std::move(global)) {
+}
+
+Value GlobalDefineNode::Execute(const Ref<Environment>& env) {
+    binding_->Define(value_->Execute(env));
+    return Value();
+}
+
+GlobalSetNode::GlobalSetNode(SymbolId name, std::shared_ptr<Node> value,
+                             std::shared_ptr<Scope> global)
+    : binding_(global->GetBinding(name)), value_(std::move(value)), global_(std::move(global)) {
+}
+
+Value GlobalSetNode::Execute(const Ref<Environment>& env) {
+    binding_->Set(value_->Execute(env));
+    return Value();
+}
+
+LambdaNode::LambdaNode(size_t arg_count, size_t local_count, NodeList body,
+                       std::shared_ptr<JitProfile> jit_profile)
+    : arg_count_(arg_count),
+      local_count_(local_count),
+      body_(std::move(body)),
+      jit_profile_(std::move(jit_profile)) {
+}
+
+Value LambdaNode::Execute(const Ref<Environment>& env) {
+    return MakeRef<LambdaCall>(env, body_, arg_count_, local_count_, jit_profile_);
+}
+
+AndNode::AndNode(NodeList args) : args_(std::move(args)) {
+}
+
+Value AndNode::Execute(const Ref<Environment>& env) {
+    auto result = Value::Boolean(true);
+    for (const auto& arg : args_) {
+        result = arg->Execute(env);
+        if (!IsTrue(result)) {
+            return result;
+        }
+    }
+    return result;
+}
+
+Value AndNode::ExecuteTail(const Ref<Environment>& env, TailCall& tail) {
+    if (args_.empty()) {
+        return Value::Boolean(true);
+    }
+    for (size_t i = 0; i + 1 < args_.size(); ++i) {
+        auto result = args_[i]->Execute(env);
+        if (!IsTrue(result)) {
+            return result;
+        }
+    }
+    return args_.back()->ExecuteTail(env, tail);
+}
+
+OrNode::OrNode(NodeList args) : args_(std::move(args)) {
+}
+
+Value OrNode::Execute(const Ref<Environment>& env) {
+    auto result = Value::Boolean(false);
+    for (const auto& arg : args_) {
+        result = arg->Execute(env);
+        if (IsTrue(result)) {
+            return result;
+        }
+    }
+    return result;
+}
+
+Value OrNode::ExecuteTail(const Ref<Environment>& env, TailCall& tail) {
+    if (args_.empty()) {
+        return Value::Boolean(false);
+    }
+    for (size_t i = 0; i + 1 < args_.size(); ++i) {
+        auto result = args_[i]->Execute(env);
+        if (IsTrue(result)) {
+            return result;
+        }
+    }
+    return args_.back()->ExecuteTail(env, tail);
+}
+
+CallNode::CallNode(std::shared_ptr<Node> function, NodeList args)
+    : function_(std::move(function)), args_(std::move(args)) {
+}
+
+Value CallNode::Execute(const Ref<Environment>& env) {
+    auto function = EvaluateFunction(env);
+    if (Function::IsBuiltin(function.GetType())) {
+        return CallBuiltin(As<Function>(function), env);
+    }
+    return As<Function>(function)->Apply(EvaluateArgs(env));
+}
+
+Value CallNode::ExecuteTail(const Ref<Environment>& env, TailCall& tail) {
+    auto function = EvaluateFunction(env);
+    if (Function::IsBuiltin(function.GetType())) {
+        return CallBuiltin(As<Function>(function), env);
+    }
+    if (!Is<LambdaCall>(function)) {
+        return As<Function>(function)->Apply(EvaluateArgs(env));
+    }
+    tail.args = EvaluateArgs(env);
+    tail.function = std::move(function);
+    return Value();
+}
+
+Value CallNode::EvaluateFunction(const Ref<Environment>& env) {
+    auto function = function_->Execute(env);
+    if (!Is<Function>(function)) {
+        throw RuntimeError("Expression should contain operator or lambda");
+    }
+    return function;
+}
+
+// Arguments of builtin calls with more than three of them are evaluated onto a per-thread stack.
+// Nested calls push above the frame, which is popped when the call returns or throws.
+class ArgumentFrame {
+public:
+    ArgumentFrame() : stack_(Stack()), base_(stack_.size()) {
+    }
+
+    ~ArgumentFrame() {
+        stack_.resize(base_);
+    }
+
+    void Push(Value value) {
+        stack_.push_back(std::move(value));
+    }
+
+    ArgSpan GetArgs() const {
+        return ArgSpan(stack_).subspan(base_);
+    }
+
+private:
+    static ObjectList& Stack() {
+        thread_local ObjectList stack;
+        return stack;
+    }
+
+    ObjectList& stack_;
+    size_t base_;
+};
+
+Value CallNode::CallBuiltin(Function* function, const Ref<Environment>& env) {
+    switch (args_.size()) {
+        case 0:
+            return function->Apply0();
+        case 1:
+            return function->Apply1(args_[0]->Execute(env));
+        case 2: {
+            auto first = args_[0]->Execute(env);
+            auto second = args_[1]->Execute(env);
+            return function->Apply2(first, second);
+        }
+        case 3: {
+            auto first = args_[0]->Execute(env);
+            auto second = args_[1]->Execute(env);
+            auto third = args_[2]->Execute(env);
+            return function->Apply3(first, second, third);
+        }
+        default: {
+            ArgumentFrame frame;
+            for (const auto& arg : args_) {
+                frame.Push(arg->Execute(env));
+            }
+            return function->ApplySpan(frame.GetArgs());
+        }
+    }
+}
+
+ObjectList CallNode::EvaluateArgs(const Ref<Environment>& env) {
+    ObjectList args;
+    args.reserve(args_.size());
+    for (const auto& arg : args_) {
+        args.push_back(arg->Execute(env));
+    }
+    return args;
+}
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "object.h"
+
+// Lambda call in tail position, left to the caller's loop so that it runs in constant C++ stack.
+struct TailCall {
+    // nil while no call is pending
+    Value function;
+    ObjectList args;
+};
+
+// Executable node of an analyzed expression. Analysis resolves special forms, checks syntax and
+// binds variables to lexical addresses once, so executing a node never inspects the source Cell
+// tree or looks up local names again.
+class Node {
+public:
+    virtual Value Execute(const Ref<Environment>& env) = 0;
+
+    // executes node in tail position, a lambda call may be stored in tail instead of performed
+    virtual Value ExecuteTail(const Ref<Environment>& env, TailCall&) {
+        return Execute(env);
+    }
+
+    virtual ~Node() = default;
+};
+
+using NodeList = std::vector<std::shared_ptr<Node>>;
+
+// Analyzes top level expression, free variables are bound to the global scope. With jit enabled
+// top level lambdas get a JitProfile and hot ones run as native code.
+std::shared_ptr<Node> Analyze(const Value& ast, std::shared_ptr<Scope> global, bool jit = false);
+
+// Collects elements of a proper list, empty list gives no elements.
+ObjectList ListToVector(Value list, const std::string& error_message);
+
+// Collects variables introduced by 'define' in lambda body, skipping nested lambdas.
+void CollectDefines(const Value& ast, std::vector<SymbolId>& names);
+
+enum class SpecialForm { kNone, kQuote, kIf, kDefine, kSet, kLambda, kAnd, kOr };
+
+// Recognizes special form keyword by interned symbol id, anything else is kNone.
+SpecialForm GetSpecialForm(const Value& head);
+
+// Compile time view of nested lambda frames, resolves local variables to (depth, slot).
+class LexicalScope {
+public:
+    using Frame = std::vector<SymbolId>;
+
+    void PushFrame(Frame frame);
+
+    void PopFrame();
+
+    // returns false for variables which are not bound by any enclosing lambda
+    bool Resolve(SymbolId name, int32_t& depth, int32_t& slot) const;
+
+    bool IsToplevel() const;
+
+private:
+    // from outermost to innermost, empty on top level
+    std::vector<Frame> frames_;
+};
+
+class Analyzer {
+public:
+    Analyzer(std::shared_ptr<Scope> global, bool jit = false);
+
+    std::shared_ptr<Node> AnalyzeExpression(const Value& ast);
+
+private:
+    NodeList AnalyzeList(const ObjectList& list, size_t start_ind);
+
+    std::shared_ptr<Node> AnalyzeQuote(const ObjectList& form);
+
+    std::shared_ptr<Node> AnalyzeIf(const ObjectList& form);
+
+    std::shared_ptr<Node> AnalyzeDefine(const ObjectList& form);
+
+    std::shared_ptr<Node> AnalyzeSet(const ObjectList& form);
+
+    std::shared_ptr<Node> AnalyzeLambda(const Value& arg_list, const ObjectList& body,
+                                        size_t body_start_ind);
+
+    std::shared_ptr<Node> AnalyzeVariableStore(SymbolId name, std::shared_ptr<Node> value,
+                                               bool is_define);
+
+    std::shared_ptr<Scope> global_;
+    LexicalScope lexical_scope_;
+    bool jit_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+class ConstantNode : public Node {
+public:
+    ConstantNode(Value value);
+
+    Value Execute(const Ref<Environment>& env) override;
+
+private:
+    Value value_;
+};
+
+class LocalRefNode : public Node {
+public:
+    LocalRefNode(int32_t depth, int32_t slot);
+
+    Value Execute(const Ref<Environment>& env) override;
+
+private:
+    int32_t depth_;
+    int32_t slot_;
+};
+
+class GlobalRefNode : public Node {
+public:
+    GlobalRefNode(SymbolId name, std::shared_ptr<Scope> global);
+
+    Value Execute(const Ref<Environment>& env) override;
+
+private:
+    Binding* binding_;
+    // owns binding_
+    std::shared_ptr<Scope> global_;
+};
+
+// call of builtins folded by Optimize, executed only if one of the builtins was rebound since
+class FoldedCallNode : public Node {
+public:
+    FoldedCallNode(Value folded, std::shared_ptr<Node> call);
+
+    Value Execute(const Ref<Environment>& env) override;
+
+    Value ExecuteTail(const Ref<Environment>& env, TailCall& tail) override;
+
+private:
+    // FoldedCall
+    Value folded_;
+    std::shared_ptr<Node> call_;
+};
+
+class IfNode : public Node {
+public:
+    IfNode(std::shared_ptr<Node> condition, std::shared_ptr<Node> true_branch,
+           std::shared_ptr<Node> false_branch);
+
+    Value Execute(const Ref<Environment>& env) override;
+
+    Value ExecuteTail(const Ref<Environment>& env, TailCall& tail) override;
+
+private:
+    std::shared_ptr<Node> condition_;
+    std::shared_ptr<Node> true_branch_;
+    std::shared_ptr<Node> false_branch_;
+};
+
+// 'define' and 'set!' of lambda local variable
+class LocalStoreNode : public Node {
+public:
+    LocalStoreNode(int32_t depth, int32_t slot, std::shared_ptr<Node> value);
+
+    Value Execute(const Ref<Environment>& env) override;
+
+private:
+    int32_t depth_;
+    int32_t slot_;
+    std::shared_ptr<Node> value_;
+};
+
+class GlobalDefineNode : public Node {
+public:
+    GlobalDefineNode(SymbolId name, std::shared_ptr<Node> value, std::shared_ptr<Scope> global);
+
+    Value Execute(const Ref<Environment>& env) override;
+
+private:
+    Binding* binding_;
+    std::shared_ptr<Node> value_;
+    std::shared_ptr<Scope> global_;
+};
+
+class GlobalSetNode : public Node {
+public:
+    GlobalSetNode(SymbolId name, std::shared_ptr<Node> value, std::shared_ptr<Scope> global);
+
+    Value Execute(const Ref<Environment>& env) override;
+
+private:
+    Binding* binding_;
+    std::shared_ptr<Node> value_;
+    std::shared_ptr<Scope> global_;
+};
+
+class LambdaNode : public Node {
+public:
+    LambdaNode(size_t arg_count, size_t local_count, NodeList body,
+               std::shared_ptr<JitProfile> jit_profile = nullptr);
+
+    Value Execute(const Ref<Environment>& env) override;
+
+private:
+    size_t arg_count_;
+    size_t local_count_;
+    NodeList body_;
+    std::shared_ptr<JitProfile> jit_profile_;
+};
+
+class AndNode : public Node {
+public:
+    AndNode(NodeList args);
+
+    Value Execute(const Ref<Environment>& env) override;
+
+    Value ExecuteTail(const Ref<Environment>& env, TailCall& tail) override;
+
+private:
+    NodeList args_;
+};
+
+class OrNode : public Node {
+public:
+    OrNode(NodeList args);
+
+    Value Execute(const Ref<Environment>& env) override;
+
+    Value ExecuteTail(const Ref<Environment>& env, TailCall& tail) override;
+
+private:
+    NodeList args_;
+};
+
+class CallNode : public Node {
+public:
+    CallNode(std::shared_ptr<Node> function, NodeList args);
+
+    Value Execute(const Ref<Environment>& env) override;
+
+    Value ExecuteTail(const Ref<Environment>& env, TailCall& tail) override;
+
+private:
+    Value EvaluateFunction(const Ref<Environment>& env);
+
+    // evaluates the arguments without building an ObjectList
+    Value CallBuiltin(Function* function, const Ref<Environment>& env);
+
+    ObjectList EvaluateArgs(const Ref<Environment>& env);
+
+    std::shared_ptr<Node> function_;
+    NodeList args_;
+};
@@ -0,0 +1,111 @@
+#include "arena.h"
+
+#include "optimizer.h"
+
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#else
+#define ASAN_POISON_MEMORY_REGION(address, size) ((void)(address), (void)(size))
+#define ASAN_UNPOISON_MEMORY_REGION(address, size) ((void)(address), (void)(size))
+#endif
+
+static constexpr size_t kAlignment = alignof(std::max_align_t);
+
+Arena::~Arena() {
+    Reset();
+}
+
+void* Arena::Allocate(size_t size) {
+    size = (size + kAlignment - 1) / kAlignment * kAlignment;
+    if (begin_ + size > end_) {
+        chunks_.emplace_back(new char[kChunkSize]);
+        begin_ = chunks_.back().get();
+        end_ = begin_ + kChunkSize;
+    }
+    auto block = begin_;
+    begin_ += size;
+    ASAN_UNPOISON_MEMORY_REGION(block, size);
+    return block;
+}
+
+void Arena::Adopt(Object* object) {
+    object->is_arena_allocated_ = true;
+    object->AddRef();
+    objects_.push_back(object);
+}
+
+void Arena::Reset() {
+    // the objects refer to each other, they drop their references before any is destroyed
+    for (auto object : objects_) {
+        if (object->GetGcNode()) {
+            object->Clear();
+        }
+    }
+    for (auto object : objects_) {
+        object->~Object();
+    }
+    objects_.clear();
+
+    if (chunks_.size() > 1) {
+        chunks_.resize(1);
+    }
+    if (!chunks_.empty()) {
+        begin_ = chunks_.front().get();
+        end_ = begin_ + kChunkSize;
+        // catches references to the tree which were not promoted
+        ASAN_POISON_MEMORY_REGION(begin_, kChunkSize);
+    }
+}
+
+// the optimizer wraps parts of the tree in heap pairs and folded calls, so the arena can be
+// reached from those too
+static bool RefersToArena(const Value& value) {
+    auto rest = value;
+    while (Is<Cell>(rest) && !As<Cell>(rest)->IsArenaAllocated()) {
+        if (RefersToArena(As<Cell>(rest)->GetFirst())) {
+            return true;
+        }
+        rest = As<Cell>(rest)->GetSecond();
+    }
+    if (Is<FoldedCall>(rest)) {
+        return RefersToArena(As<FoldedCall>(rest)->GetCall());
+    }
+    auto object = rest.GetObject();
+    return object && object->IsArenaAllocated();
+}
+
+static Value CopyTree(const Value& value) {
+    if (Is<FoldedCall>(value)) {
+        auto folded = As<FoldedCall>(value);
+        return MakeRef<FoldedCall>(folded->GetValue(), CopyTree(folded->GetCall()),
+                                   folded->GetGuards());
+    }
+    if (!Is<Cell>(value)) {
+        if (value.GetObject() && value.GetObject()->IsArenaAllocated()) {
+            throw RuntimeError("Object can't be promoted from the arena");
+        }
+        return value;
+    }
+
+    // copies the spine in a loop, only nested lists recurse
+    Value head;
+    Cell* tail = nullptr;
+    auto rest = value;
+    while (Is<Cell>(rest)) {
+        auto cell = As<Cell>(rest);
+        Value copy = MakeRef<Cell>(CopyTree(cell->GetFirst()));
+        if (tail) {
+            tail->SetSecond(copy);
+        } else {
+            head = copy;
+        }
+        tail = As<Cell>(copy);
+        rest = cell->GetSecond();
+    }
+    tail->SetSecond(CopyTree(rest));
+    return head;
+}
+
+Value Arena::Promote(const Value& value) {
+    return RefersToArena(value) ? CopyTree(value) : value;
+}
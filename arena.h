@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "object.h"
+
+// Region for the syntax tree of one input. The reader places its pairs here and the whole region
+// is released in one shot once the input is executed. Code which keeps a part of the tree beyond
+// that, e.g. a quoted constant or the body of a lambda, stores Promote(value).
+class Arena {
+public:
+    Arena() = default;
+
+    Arena(const Arena&) = delete;
+
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena();
+
+    template <class T, class... Args>
+    Ref<T> Make(Args&&... args) {
+        // the tree is never mutated, so it can't form cycles and the collector skips it
+        Heap::Activation untracked(nullptr);
+        auto object = ::new (Allocate(sizeof(T))) T(std::forward<Args>(args)...);
+        Adopt(object);
+        return Ref<T>(object);
+    }
+
+    // destroys all objects, the first chunk is kept for the next input
+    void Reset();
+
+    // value itself unless it refers to an object in an arena, a copy on the heap otherwise
+    static Value Promote(const Value& value);
+
+    static constexpr size_t kChunkSize = 16 * 1024;
+
+    // Resets the arena when the scope ends, declared before anything which refers to the tree.
+    class ResetGuard {
+    public:
+        explicit ResetGuard(Arena* arena) : arena_(arena) {
+        }
+
+        ResetGuard(const ResetGuard&) = delete;
+
+        ResetGuard& operator=(const ResetGuard&) = delete;
+
+        ~ResetGuard() {
+            arena_->Reset();
+        }
+
+    private:
+        Arena* arena_;
+    };
+
+private:
+    void* Allocate(size_t size);
+
+    // the arena holds a reference, so reference counting never frees the object
+    void Adopt(Object* object);
+
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char* begin_ = nullptr;
+    char* end_ = nullptr;
+    std::vector<Object*> objects_;
+};
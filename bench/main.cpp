@@ -0,0 +1,75 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "scheme.h"
+
+// Runs fixed workloads on both engines and prints the best wall time of several runs.
+
+struct Benchmark {
+    std::string name;
+    std::vector<std::string> setup;
+    std::string expression;
+    std::string expected;
+};
+
+const std::vector<Benchmark> kBenchmarks = {
+    {"fib 25",
+     {"(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))"},
+     "(fib 25)",
+     "75025"},
+    {"fib 30",
+     {"(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))"},
+     "(fib 30)",
+     "832040"},
+    {"tak 18 12 6",
+     {"(define (tak x y z) (if (not (< y x)) z "
+      "(tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y))))"},
+     "(tak 18 12 6)",
+     "7"},
+    {"loop sum",
+     {"(define (sum n acc) (if (= n 0) acc (sum (- n 1) (+ acc n))))"},
+     "(sum 1000000 0)",
+     "500000500000"},
+    {"constant rule",
+     {"(define (rule x) "
+      "(+ x (* (- 100 (abs -7)) (max 3 (min 8 9)) (+ 1 2 3 4 5 6 7 8 9 10))))",
+      "(define (loop n acc) (if (= n 0) acc (loop (- n 1) (rule acc))))"},
+     "(loop 100000 0)",
+     "4092000000"},
+};
+
+constexpr int kRuns = 5;
+
+double Measure(Engine engine, const Benchmark& benchmark) {
+    double best = 0;
+    for (int run = 0; run < kRuns; ++run) {
+        Interpreter interpreter(engine);
+        for (const auto& line : benchmark.setup) {
+            interpreter.Run(line);
+        }
+        auto start = std::chrono::steady_clock::now();
+        auto result = interpreter.Run(benchmark.expression);
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        if (result != benchmark.expected) {
+            std::cerr << benchmark.name << ": expected " << benchmark.expected << ", got "
+                      << result << "\n";
+            std::exit(1);
+        }
+        if (run == 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+    }
+    return best;
+}
+
+int main() {
+    for (const auto& benchmark : kBenchmarks) {
+        std::cout << benchmark.name << ": tree " << Measure(Engine::kTreeWalker, benchmark)
+                  << " ms, bytecode " << Measure(Engine::kBytecode, benchmark) << " ms, jit "
+                  << Measure(Engine::kJit, benchmark) << " ms\n";
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "scanner.h"
+#include "tokenizer.h"
+
+// Tokenizes generated corpora and prints the best throughput of several runs for the stream
+// tokenizer and for the buffer tokenizer at every scan level the CPU supports.
+
+struct Corpus {
+    std::string name;
+    std::string text;
+};
+
+constexpr size_t kCorpusSize = 16 << 20;
+constexpr int kRuns = 5;
+
+static std::string MakeCode() {
+    std::string text;
+    for (int i = 0; text.size() < kCorpusSize; ++i) {
+        auto name = "f" + std::to_string(i % 1000);
+        text += "(define (" + name + " x) (if (< x 2) x (+ (" + name + " (- x 1)) 'a #t)))\n";
+    }
+    return text;
+}
+
+static std::string MakeData() {
+    std::string text = "(";
+    for (int i = 0; text.size() < kCorpusSize; ++i) {
+        text += std::to_string(i * 7919 % 100000000 - 50000000) + (i % 16 == 15 ? "\n" : " ");
+    }
+    return text + ")";
+}
+
+static std::string MakeIndented() {
+    std::string text;
+    for (int i = 0; text.size() < kCorpusSize; ++i) {
+        text += "(record-" + std::to_string(i % 100) + "\n";
+        for (int depth = 1; depth <= 8; ++depth) {
+            text += std::string(4 * depth, ' ') + "(field-with-a-descriptive-name " +
+                    "another-rather-long-symbol-name?)\n";
+        }
+        text += ")\n";
+    }
+    return text;
+}
+
+template <class MakeTokenizer>
+static double Measure(const std::string& text, MakeTokenizer make_tokenizer) {
+    double best = 0;
+    for (int run = 0; run < kRuns; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        auto tokenizer = make_tokenizer();
+        size_t count = 0;
+        for (; !tokenizer->IsEnd(); tokenizer->Next()) {
+            ++count;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (count == 0) {
+            std::exit(1);
+        }
+        best = std::max(best, text.size() / elapsed.count() / 1e6);
+    }
+    return best;
+}
+
+int main() {
+    std::vector<Corpus> corpora = {
+        {"code", MakeCode()}, {"data", MakeData()}, {"indented", MakeIndented()}};
+    std::vector<std::pair<ScanLevel, std::string>> levels = {
+        {ScanLevel::kScalar, "scalar"}, {ScanLevel::kSse2, "sse2"}, {ScanLevel::kAvx2, "avx2"}};
+    for (const auto& corpus : corpora) {
+        std::stringstream stream;
+        std::cout << corpus.name << ": stream " << Measure(corpus.text, [&] {
+            stream = std::stringstream(corpus.text);
+            return std::make_unique<Tokenizer>(&stream);
+        }) << " MB/s";
+        for (const auto& [level, name] : levels) {
+            if (level > GetMaxScanLevel()) {
+                continue;
+            }
+            SetScanLevel(level);
+            std::cout << ", " << name << " " << Measure(corpus.text, [&] {
+                return std::make_unique<Tokenizer>(std::string_view{corpus.text});
+            }) << " MB/s";
+        }
+        SetScanLevel(GetMaxScanLevel());
+        std::cout << "\n";
+    }
+    return 0;
+}
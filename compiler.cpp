@@ -0,0 +1,271 @@
+#include "compiler.h"
+
+#include <utility>
+
+#include "arena.h"
+#include "optimizer.h"
+
+std::shared_ptr<CodeObject> Compile(const Value& ast, std::shared_ptr<Scope> global) {
+    return Compiler(std::move(global)).CompileToplevel(ast);
+}
+
+Compiler::Compiler(std::shared_ptr<Scope> global) : global_(std::move(global)) {
+}
+
+std::shared_ptr<CodeObject> Compiler::CompileToplevel(const Value& ast) {
+    code_ = std::make_shared<CodeObject>();
+    slots_ = Slots();
+    lexical_scope_ = LexicalScope();
+    CompileExpression(ast, true);
+    Emit(Opcode::kReturn);
+    return code_;
+}
+
+void Compiler::CompileExpression(const Value& ast, bool tail) {
+    if (!ast) {
+        throw RuntimeError("Invalid expression");
+    }
+    if (Is<Symbol>(ast)) {
+        int32_t depth;
+        int32_t slot;
+        auto name = As<Symbol>(ast)->GetId();
+        if (lexical_scope_.Resolve(name, depth, slot)) {
+            Emit(Opcode::kLoadLocal, depth, slot);
+        } else {
+            Emit(Opcode::kLoadGlobal, AddBinding(name));
+        }
+        return;
+    }
+    if (Is<FoldedCall>(ast)) {
+        CompileFoldedCall(ast, tail);
+        return;
+    }
+    if (!Is<Cell>(ast)) {
+        Emit(Opcode::kPushConst, AddConstant(Arena::Promote(ast)));
+        return;
+    }
+
+    auto form = ListToVector(ast, "Incorrect expression syntax");
+    if (!form.front()) {
+        throw RuntimeError("Expression should contain operator");
+    }
+
+    switch (GetSpecialForm(form.front())) {
+        case SpecialForm::kQuote:
+            CompileQuote(form);
+            return;
+        case SpecialForm::kIf:
+            CompileIf(form, tail);
+            return;
+        case SpecialForm::kDefine:
+            CompileDefine(form);
+            return;
+        case SpecialForm::kSet:
+            CompileSet(form);
+            return;
+        case SpecialForm::kLambda:
+            if (form.size() < 2) {
+                throw SyntaxError("Lambda should have args");
+            }
+            CompileLambda(form[1], form, 2);
+            return;
+        case SpecialForm::kAnd:
+            CompileLogic(form, true, tail);
+            return;
+        case SpecialForm::kOr:
+            CompileLogic(form, false, tail);
+            return;
+        case SpecialForm::kNone:
+            CompileCall(form, tail);
+            return;
+    }
+}
+
+void Compiler::CompileFoldedCall(const Value& folded, bool tail) {
+    // the tree of toplevel code is gone with the code, lambdas keep theirs
+    Emit(Opcode::kPushFolded,
+         AddConstant(lexical_scope_.IsToplevel() ? folded : Arena::Promote(folded)), -1);
+    auto end_jump = code_->code.size() - 1;
+    CompileExpression(As<FoldedCall>(folded)->GetCall(), tail);
+    PatchJump(end_jump);
+}
+
+void Compiler::CompileQuote(const ObjectList& form) {
+    if (form.size() != 2) {
+        throw SyntaxError("Incorrect 'quote' syntax");
+    }
+    Emit(Opcode::kPushConst, AddConstant(Arena::Promote(form[1])));
+}
+
+void Compiler::CompileIf(const ObjectList& form, bool tail) {
+    if (form.size() != 3 && form.size() != 4) {
+        throw SyntaxError("Incorrect 'if' syntax");
+    }
+    CompileExpression(form[1], false);
+    auto else_jump = EmitJump(Opcode::kJumpIfFalse);
+
+    CompileExpression(form[2], tail);
+    auto end_jump = EmitJump(Opcode::kJump);
+
+    PatchJump(else_jump);
+    if (form.size() == 4) {
+        CompileExpression(form[3], tail);
+    } else {
+        Emit(Opcode::kPushNil);
+    }
+    PatchJump(end_jump);
+}
+
+void Compiler::CompileDefine(const ObjectList& form) {
+    if (form.size() < 3) {
+        throw SyntaxError("Incorrect 'define/set' syntax");
+    }
+
+    Value name;
+    if (Is<Cell>(form[1])) {
+        // lambda syntax sugar: (define (name args...) body...)
+        name = As<Cell>(form[1])->GetFirst();
+        if (!Is<Symbol>(name)) {
+            throw SyntaxError("Name of variable should be a symbol");
+        }
+        CompileLambda(As<Cell>(form[1])->GetSecond(), form, 2);
+    } else {
+        name = form[1];
+        if (!Is<Symbol>(name)) {
+            throw SyntaxError("Name of variable should be a symbol");
+        }
+        if (form.size() != 3) {
+            throw SyntaxError("Incorrect 'define/set' syntax");
+        }
+        CompileExpression(form[2], false);
+    }
+    CompileVariableStore(As<Symbol>(name)->GetId(), true);
+}
+
+void Compiler::CompileSet(const ObjectList& form) {
+    if (form.size() != 3 || !Is<Symbol>(form[1])) {
+        throw SyntaxError("Incorrect 'define/set' syntax");
+    }
+    CompileExpression(form[2], false);
+    CompileVariableStore(As<Symbol>(form[1])->GetId(), false);
+}
+
+void Compiler::CompileVariableStore(SymbolId name, bool is_define) {
+    int32_t depth;
+    int32_t slot;
+    if (lexical_scope_.Resolve(name, depth, slot)) {
+        Emit(Opcode::kStoreLocal, depth, slot);
+    } else {
+        Emit(is_define ? Opcode::kDefineGlobal : Opcode::kSetGlobal, AddBinding(name));
+    }
+    Emit(Opcode::kPushNil);
+}
+
+void Compiler::CompileLambda(const Value& arg_list, const ObjectList& body, size_t body_start_ind) {
+    LexicalScope::Frame frame;
+    for (const auto& arg : ListToVector(arg_list, "Wrong lambda args syntax")) {
+        if (!Is<Symbol>(arg)) {
+            throw SyntaxError("Lambda args should be Symbol type");
+        }
+        frame.push_back(As<Symbol>(arg)->GetId());
+    }
+    if (body_start_ind >= body.size()) {
+        throw SyntaxError("Lambda should have body");
+    }
+
+    auto function = std::make_shared<CodeObject>();
+    function->arg_count = frame.size();
+    for (size_t i = body_start_ind; i < body.size(); ++i) {
+        CollectDefines(body[i], frame);
+    }
+    function->local_count = frame.size();
+
+    // compile body into its own code object
+    auto outer = std::move(code_);
+    auto outer_slots = std::exchange(slots_, Slots());
+    code_ = function;
+    lexical_scope_.PushFrame(std::move(frame));
+    for (size_t i = body_start_ind; i < body.size(); ++i) {
+        bool is_last = i + 1 == body.size();
+        CompileExpression(body[i], is_last);
+        Emit(is_last ? Opcode::kReturn : Opcode::kPop);
+    }
+    lexical_scope_.PopFrame();
+    code_ = std::move(outer);
+    slots_ = std::move(outer_slots);
+
+    code_->functions.push_back(function);
+    Emit(Opcode::kMakeClosure, static_cast<int32_t>(code_->functions.size() - 1));
+}
+
+void Compiler::CompileLogic(const ObjectList& form, bool is_and, bool tail) {
+    if (form.size() == 1) {
+        Emit(Opcode::kPushConst, AddConstant(Value::Boolean(is_and)));
+        return;
+    }
+
+    std::vector<size_t> end_jumps;
+    for (size_t i = 1; i < form.size(); ++i) {
+        bool is_last = i + 1 == form.size();
+        CompileExpression(form[i], tail && is_last);
+        if (!is_last) {
+            end_jumps.push_back(EmitJump(is_and ? Opcode::kJumpIfFalseKeep
+                                                : Opcode::kJumpIfTrueKeep));
+        }
+    }
+    for (auto jump : end_jumps) {
+        PatchJump(jump);
+    }
+}
+
+void Compiler::CompileCall(const ObjectList& form, bool tail) {
+    for (const auto& element : form) {
+        CompileExpression(element, false);
+    }
+    Emit(tail ? Opcode::kTailCall : Opcode::kCall, static_cast<int32_t>(form.size() - 1));
+}
+
+void Compiler::Emit(Opcode opcode) {
+    code_->code.push_back(static_cast<int32_t>(opcode));
+}
+
+void Compiler::Emit(Opcode opcode, int32_t operand) {
+    Emit(opcode);
+    code_->code.push_back(operand);
+}
+
+void Compiler::Emit(Opcode opcode, int32_t first_operand, int32_t second_operand) {
+    Emit(opcode, first_operand);
+    code_->code.push_back(second_operand);
+}
+
+size_t Compiler::EmitJump(Opcode opcode) {
+    Emit(opcode, -1);
+    return code_->code.size() - 1;
+}
+
+void Compiler::PatchJump(size_t operand_pos) {
+    code_->code[operand_pos] = static_cast<int32_t>(code_->code.size());
+}
+
+int32_t Compiler::AddConstant(Value constant) {
+    // repeated literals share a slot, quoted lists are compared by identity since they're mutable
+    auto& constants = code_->constants;
+    auto [it, inserted] =
+        slots_.constants.try_emplace(constant, static_cast<int32_t>(constants.size()));
+    if (inserted) {
+        constants.push_back(std::move(constant));
+    }
+    return it->second;
+}
+
+int32_t Compiler::AddBinding(SymbolId name) {
+    auto binding = global_->GetBinding(name);
+    auto& bindings = code_->bindings;
+    auto [it, inserted] =
+        slots_.bindings.try_emplace(binding, static_cast<int32_t>(bindings.size()));
+    if (inserted) {
+        bindings.push_back(binding);
+    }
+    return it->second;
+}
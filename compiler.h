@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "analyzer.h"
+#include "object.h"
+
+// Bytecode instruction set. Operands follow the opcode as separate words.
+enum class Opcode : int32_t {
+    kPushConst,        // index: push constants[index]
+    kPushNil,          // push the empty list
+    kPushFolded,       // index, target: if FoldedCall constants[index] is valid push its value
+                       // and jump to target, otherwise continue with the call
+    kLoadLocal,        // depth, slot: push environment slot
+    kStoreLocal,       // depth, slot: pop value into environment slot
+    kLoadGlobal,       // index: push value of bindings[index]
+    kDefineGlobal,     // index: pop value and define bindings[index]
+    kSetGlobal,        // index: pop value and rebind bindings[index], which must be defined
+    kMakeClosure,      // index: push closure over functions[index] and current environment
+    kCall,             // argc: call function below argc arguments
+    kTailCall,         // argc: same as call, but reuses current frame
+    kJump,             // target
+    kJumpIfFalse,      // target: pop condition, jump if it is #f
+    kJumpIfFalseKeep,  // target: jump keeping condition if it is #f, pop it otherwise
+    kJumpIfTrueKeep,   // target: jump keeping condition if it is true, pop it otherwise
+    kPop,
+    kReturn,
+    kOpcodeCount
+};
+
+struct CodeObject {
+    std::vector<int32_t> code;
+    ObjectList constants;
+    // global variables used by this code, owned by the global scope it was compiled against
+    std::vector<Binding*> bindings;
+    std::vector<std::shared_ptr<CodeObject>> functions;
+    size_t arg_count = 0;
+    // arguments first, then variables introduced by internal 'define'
+    size_t local_count = 0;
+};
+
+// Compiles expression read by parser into bytecode executed by VirtualMachine, free variables are
+// bound to the global scope.
+std::shared_ptr<CodeObject> Compile(const Value& ast, std::shared_ptr<Scope> global);
+
+class Compiler {
+public:
+    Compiler(std::shared_ptr<Scope> global);
+
+    std::shared_ptr<CodeObject> CompileToplevel(const Value& ast);
+
+private:
+    void CompileExpression(const Value& ast, bool tail);
+
+    void CompileFoldedCall(const Value& folded, bool tail);
+
+    void CompileQuote(const ObjectList& form);
+
+    void CompileIf(const ObjectList& form, bool tail);
+
+    void CompileDefine(const ObjectList& form);
+
+    void CompileSet(const ObjectList& form);
+
+    void CompileLambda(const Value& arg_list, const ObjectList& body, size_t body_start_ind);
+
+    void CompileLogic(const ObjectList& form, bool is_and, bool tail);
+
+    void CompileCall(const ObjectList& form, bool tail);
+
+    void CompileVariableStore(SymbolId name, bool is_define);
+
+    void Emit(Opcode opcode);
+
+    void Emit(Opcode opcode, int32_t operand);
+
+    void Emit(Opcode opcode, int32_t first_operand, int32_t second_operand);
+
+    // emits jump with unknown target, returns operand position to patch
+    size_t EmitJump(Opcode opcode);
+
+    void PatchJump(size_t operand_pos);
+
+    int32_t AddConstant(Value constant);
+
+    int32_t AddBinding(SymbolId name);
+
+    // slots of code_ pools, so that repeated constants and variables are found without a scan
+    struct Slots {
+        std::unordered_map<Value, int32_t, Value::IdentityHash, Value::IdentityEqual> constants;
+        std::unordered_map<Binding*, int32_t> bindings;
+    };
+
+    // code object of innermost lambda being compiled
+    std::shared_ptr<CodeObject> code_;
+    Slots slots_;
+    std::shared_ptr<Scope> global_;
+    LexicalScope lexical_scope_;
+};
@@ -13,3 +13,7 @@ struct RuntimeError : public std::runtime_error {
 struct NameError : public std::runtime_error {
     using std::runtime_error::runtime_error;
 };
+
+struct MemoryError : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
@@ -0,0 +1,206 @@
+#include "gc.h"
+
+#include <algorithm>
+#include <string>
+
+#include "error.h"
+
+static Heap*& CurrentHeap() {
+    thread_local Heap* heap = nullptr;
+    return heap;
+}
+
+void* RefCounted::operator new(size_t size) {
+    if (auto heap = CurrentHeap()) {
+        heap->Charge(size);
+        pending_charge_ = true;
+    }
+    return ObjectPool::Allocate(size);
+}
+
+void RefCounted::operator delete(void* block, size_t size) {
+    if (auto heap = CurrentHeap(); heap && freed_charge_) {
+        heap->Credit(size);
+    }
+    ObjectPool::Free(block, size);
+}
+
+GcNode::GcNode(RefCounted* owner) {
+    Attach(owner);
+}
+
+GcNode::~GcNode() {
+    Detach();
+}
+
+void GcNode::Attach(RefCounted* owner) {
+    auto heap = CurrentHeap();
+    if (heap_ == heap) {
+        return;
+    }
+    Detach();
+    if (heap) {
+        heap->Add(owner, this);
+    }
+}
+
+void GcNode::Detach() {
+    if (heap_) {
+        heap_->Remove(this);
+    }
+}
+
+Heap::~Heap() {
+    for (auto generation : {&young_, &old_}) {
+        for (auto entry : *generation) {
+            entry.node->heap_ = nullptr;
+        }
+    }
+}
+
+void Heap::Add(RefCounted* owner, GcNode* node) {
+    node->heap_ = this;
+    node->is_old_ = false;
+    node->index_ = young_.size();
+    young_.push_back({owner, node});
+}
+
+void Heap::Remove(GcNode* node) {
+    // the owner may be in its destructor, only the nodes are touched
+    auto& generation = node->is_old_ ? old_ : young_;
+    auto last = generation.back();
+    generation[node->index_] = last;
+    last.node->index_ = node->index_;
+    generation.pop_back();
+    node->heap_ = nullptr;
+}
+
+size_t Heap::Collect() {
+    auto freed = CollectGenerations(true);
+    ++collections_;
+    collect_threshold_ = std::max(kMinCollectThreshold, 2 * old_.size());
+    return freed;
+}
+
+size_t Heap::CollectYoung() {
+    auto freed = CollectGenerations(false);
+    ++young_collections_;
+    return freed;
+}
+
+void Heap::CollectDue() {
+    if (old_.size() >= collect_threshold_) {
+        Collect();
+    } else {
+        CollectYoung();
+    }
+}
+
+size_t Heap::CollectGenerations(bool full) {
+    // young nodes first, then the old ones if they are collected too
+    std::vector<Entry> nodes = young_;
+    if (full) {
+        nodes.insert(nodes.end(), old_.begin(), old_.end());
+    }
+    auto position = [this](GcNode* node) {
+        return node->is_old_ ? young_.size() + node->index_ : node->index_;
+    };
+    auto is_collected = [this, full](GcNode* node) {
+        return node->heap_ == this && (full || !node->is_old_);
+    };
+
+    // references each node gets from outside of the collected nodes
+    constexpr int64_t kReachable = -1;
+    std::vector<int64_t> external(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        external[i] = nodes[i].owner->GetRefCount();
+        if (external[i] == 0) {
+            // not owned by Ref, e.g. a local variable, so it is a root
+            external[i] = 1;
+        }
+    }
+    std::vector<GcNode*> children;
+    for (auto entry : nodes) {
+        children.clear();
+        entry.owner->Trace(children);
+        for (auto child : children) {
+            if (is_collected(child)) {
+                --external[position(child)];
+            }
+        }
+    }
+
+    std::vector<size_t> stack;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (external[i] > 0) {
+            external[i] = kReachable;
+            stack.push_back(i);
+        }
+    }
+    while (!stack.empty()) {
+        auto i = stack.back();
+        stack.pop_back();
+        children.clear();
+        nodes[i].owner->Trace(children);
+        for (auto child : children) {
+            if (is_collected(child) && external[position(child)] != kReachable) {
+                external[position(child)] = kReachable;
+                stack.push_back(position(child));
+            }
+        }
+    }
+
+    // owners keep the garbage alive until all of it is cleared, clearing may free other objects
+    // and so change the generations
+    std::vector<Ref<RefCounted>> garbage;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (external[i] != kReachable) {
+            garbage.emplace_back(nodes[i].owner);
+        }
+    }
+    for (const auto& owner : garbage) {
+        owner->Clear();
+    }
+    auto freed = garbage.size();
+    garbage.clear();
+
+    for (auto entry : young_) {
+        entry.node->is_old_ = true;
+        entry.node->index_ = old_.size();
+        old_.push_back(entry);
+    }
+    young_.clear();
+
+    freed_last_ = freed;
+    freed_total_ += freed;
+    return freed;
+}
+
+void Heap::ThrowLimitExceeded() const {
+    throw MemoryError("Memory limit of " + std::to_string(limit_bytes_) + " bytes exceeded");
+}
+
+HeapStats Heap::GetStats() const {
+    return HeapStats{.tracked = young_.size() + old_.size(),
+                     .young = young_.size(),
+                     .collections = collections_,
+                     .young_collections = young_collections_,
+                     .freed_last = freed_last_,
+                     .freed_total = freed_total_,
+                     .allocated_bytes = allocated_bytes_,
+                     .live_bytes = live_bytes_,
+                     .peak_bytes = peak_bytes_,
+                     .limit_bytes = limit_bytes_};
+}
+
+Heap* Heap::Current() {
+    return CurrentHeap();
+}
+
+Heap::Activation::Activation(Heap* heap) : previous_(CurrentHeap()) {
+    CurrentHeap() = heap;
+}
+
+Heap::Activation::~Activation() {
+    CurrentHeap() = previous_;
+}
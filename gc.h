@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ref.h"
+
+class Heap;
+
+// Part of an object which can take part in a reference cycle: pairs, closures and call frames.
+// Reference counting frees everything else, nodes created while a Heap is active also register
+// with it so that its collector can find cycles. The virtual functions of the owner serve the
+// node, so a pair carries a single vtable pointer.
+class GcNode {
+public:
+    explicit GcNode(RefCounted* owner);
+
+    // a copy is a new node, the copy of the owner registers it with its own address
+    GcNode(const GcNode& other) = delete;
+
+    GcNode& operator=(const GcNode&) {
+        return *this;
+    }
+
+    ~GcNode();
+
+    // moves the node to the heap which is active now, e.g. when a pooled frame is reused
+    void Attach(RefCounted* owner);
+
+private:
+    friend class Heap;
+
+    void Detach();
+
+    Heap* heap_ = nullptr;
+    // position in the vector of its generation
+    uint32_t index_ = 0;
+    bool is_old_ = false;
+};
+
+struct HeapStats {
+    // nodes registered right now
+    size_t tracked = 0;
+    // nodes created since the last collection
+    size_t young = 0;
+    size_t collections = 0;
+    size_t young_collections = 0;
+    size_t freed_last = 0;
+    size_t freed_total = 0;
+    // bytes of objects created while the heap was active
+    size_t allocated_bytes = 0;
+    // bytes of those objects which are not freed yet
+    size_t live_bytes = 0;
+    size_t peak_bytes = 0;
+    // 0 if there is no limit
+    size_t limit_bytes = 0;
+};
+
+// Nodes created by one interpreter and the backup tracing collector which frees their cycles.
+// References from anything the heap does not track, e.g. the global Scope, the analyzed code,
+// C++ locals of running calls and the virtual machine stack, make up the root set: a node is
+// alive if its use count exceeds the references it gets from other tracked nodes, or if it can
+// be reached from such a node. The rest is cyclic garbage, collection clears its references and
+// lets reference counting free it.
+//
+// Nodes are kept in two generations. Most cycles die young, so frequent young collections look
+// only at the nodes created since the previous collection and promote the survivors, their pause
+// is bounded by kYoungLimit. References from old nodes need no write barrier: they are part of the
+// use count and keep young nodes alive like any other outside reference. Full collections run
+// when the old generation doubles.
+//
+// The heap also accounts for the memory of its interpreter. An object is charged to the heap
+// active when it is created and credited to the one active when it is freed, an interpreter
+// activates its heap whenever it runs code. Only the objects themselves are counted, not the
+// buffers they own, nor the syntax tree in the arena.
+class Heap {
+public:
+    Heap() = default;
+
+    Heap(const Heap&) = delete;
+
+    Heap& operator=(const Heap&) = delete;
+
+    // nodes which outlive the heap stay valid, they are just not tracked any more
+    ~Heap();
+
+    // frees unreachable cycles, returns the number of freed nodes
+    size_t Collect();
+
+    // frees unreachable cycles among young nodes, promotes the others to the old generation
+    size_t CollectYoung();
+
+    // collects the generations which outgrew their limits, called at safe points: between
+    // expressions and at the start of lambda calls
+    void MaybeCollect() {
+        if (young_.size() >= kYoungLimit || old_.size() >= collect_threshold_) {
+            CollectDue();
+        }
+    }
+
+    HeapStats GetStats() const;
+
+    // creating an object which takes live bytes over the limit throws MemoryError, 0 removes it
+    void SetLimit(size_t bytes) {
+        limit_bytes_ = bytes;
+    }
+
+    // heap of the interpreter running on this thread, nullptr outside of any
+    static Heap* Current();
+
+    static constexpr size_t kYoungLimit = 4096;
+    static constexpr size_t kMinCollectThreshold = 10000;
+
+    // Makes a heap current for its lifetime, the previous one is restored afterwards.
+    class Activation {
+    public:
+        explicit Activation(Heap* heap);
+
+        Activation(const Activation&) = delete;
+
+        Activation& operator=(const Activation&) = delete;
+
+        ~Activation();
+
+    private:
+        Heap* previous_;
+    };
+
+private:
+    friend class Environment;
+    friend class GcNode;
+    friend class RefCounted;
+
+    // inline, call frames taken from the pool are charged on every call
+    void Charge(size_t size) {
+        if (limit_bytes_ && live_bytes_ + size > limit_bytes_) {
+            ThrowLimitExceeded();
+        }
+        allocated_bytes_ += size;
+        live_bytes_ += size;
+        peak_bytes_ = std::max(peak_bytes_, live_bytes_);
+    }
+
+    void Credit(size_t size) {
+        // objects are freed while the heap they were charged to is active
+        assert(live_bytes_ >= size);
+        live_bytes_ -= size;
+    }
+
+    [[noreturn]] void ThrowLimitExceeded() const;
+
+    struct Entry {
+        RefCounted* owner;
+        GcNode* node;
+    };
+
+    void Add(RefCounted* owner, GcNode* node);
+
+    void Remove(GcNode* node);
+
+    void CollectDue();
+
+    size_t CollectGenerations(bool full);
+
+    std::vector<Entry> young_;
+    std::vector<Entry> old_;
+    // full collection is due when the old generation reaches it
+    size_t collect_threshold_ = kMinCollectThreshold;
+    size_t collections_ = 0;
+    size_t young_collections_ = 0;
+    size_t freed_last_ = 0;
+    size_t freed_total_ = 0;
+    size_t allocated_bytes_ = 0;
+    size_t live_bytes_ = 0;
+    size_t peak_bytes_ = 0;
+    size_t limit_bytes_ = 0;
+};
@@ -0,0 +1,556 @@
+#include "jit.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+
+#include "analyzer.h"
+#include "arena.h"
+#include "optimizer.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define SCHEME_JIT_X86_64
+#endif
+
+#ifdef SCHEME_JIT_X86_64
+
+// Shared with generated code, the trampoline addresses the fields by their offsets.
+struct JitContext {
+    // stack pointer to restore on bailout
+    uintptr_t saved_rsp;
+    // native recursion bails out below this stack address
+    uintptr_t stack_limit;
+    const int64_t* args;
+    int64_t result;
+};
+
+static_assert(offsetof(JitContext, saved_rsp) == 0);
+static_assert(offsetof(JitContext, stack_limit) == 8);
+static_assert(offsetof(JitContext, args) == 16);
+static_assert(offsetof(JitContext, result) == 24);
+
+static constexpr size_t kMaxArgs = 8;
+static constexpr uintptr_t kStackBudget = 512 * 1024;
+
+// Executable copy of generated machine code and the globals it was compiled against.
+class JitCode {
+public:
+    JitCode(const std::vector<uint8_t>& machine_code, std::vector<BindingGuard> guards,
+            size_t arg_count)
+        : guards_(std::move(guards)), arg_count_(arg_count) {
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        size_ = (machine_code.size() + page_size - 1) / page_size * page_size;
+        memory_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory_ == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        std::memcpy(memory_, machine_code.data(), machine_code.size());
+        // the buffer is never writable and executable at the same time
+        if (mprotect(memory_, size_, PROT_READ | PROT_EXEC) != 0) {
+            munmap(memory_, size_);
+            throw std::bad_alloc();
+        }
+    }
+
+    JitCode(const JitCode&) = delete;
+
+    JitCode& operator=(const JitCode&) = delete;
+
+    ~JitCode() {
+        munmap(memory_, size_);
+    }
+
+    // nothing if a guard fails, an argument is not an integer or the native call bailed out
+    std::optional<Value> Call(const ObjectList& args, bool& bailed_out) {
+        for (const auto& guard : guards_) {
+            if (!guard.IsValid()) {
+                return std::nullopt;
+            }
+        }
+        if (args.size() != arg_count_) {
+            return std::nullopt;
+        }
+        int64_t values[kMaxArgs];
+        for (size_t i = 0; i < args.size(); ++i) {
+            auto number = As<Number>(args[i]);
+            if (!number) {
+                return std::nullopt;
+            }
+            values[i] = number->GetValue();
+        }
+
+        auto frame = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+        JitContext context{
+            .saved_rsp = 0, .stack_limit = frame - kStackBudget, .args = values, .result = 0};
+        auto entry = reinterpret_cast<int (*)(JitContext*)>(memory_);
+        if (!entry(&context)) {
+            bailed_out = true;
+            return std::nullopt;
+        }
+        return Value::Integer(context.result);
+    }
+
+private:
+    void* memory_;
+    size_t size_;
+    std::vector<BindingGuard> guards_;
+    size_t arg_count_;
+};
+
+// Appends x86-64 instructions to a byte buffer, only the encodings used by JitCompiler.
+class X86Assembler {
+public:
+    void Bytes(std::initializer_list<uint8_t> bytes) {
+        code_.insert(code_.end(), bytes);
+    }
+
+    void Imm32(int32_t value) {
+        Raw(&value, sizeof(value));
+    }
+
+    void Imm64(int64_t value) {
+        Raw(&value, sizeof(value));
+    }
+
+    // emits instruction ending with rel32 operand, returns operand position to patch
+    size_t Rel32(std::initializer_list<uint8_t> opcode) {
+        Bytes(opcode);
+        Imm32(0);
+        return code_.size() - 4;
+    }
+
+    void Patch(size_t operand_pos, size_t target) {
+        auto offset = static_cast<int32_t>(target - (operand_pos + 4));
+        std::memcpy(code_.data() + operand_pos, &offset, sizeof(offset));
+    }
+
+    size_t Here() const {
+        return code_.size();
+    }
+
+    const std::vector<uint8_t>& GetCode() const {
+        return code_;
+    }
+
+    // mov rax, value
+    void MovRaxImm(int64_t value) {
+        if (value >= INT32_MIN && value <= INT32_MAX) {
+            Bytes({0x48, 0xC7, 0xC0});
+            Imm32(static_cast<int32_t>(value));
+        } else {
+            Bytes({0x48, 0xB8});
+            Imm64(value);
+        }
+    }
+
+    // mov rax, [rbp + disp]
+    void LoadRbp(int32_t disp) {
+        Bytes({0x48, 0x8B, 0x85});
+        Imm32(disp);
+    }
+
+    // mov [rbp + disp], rax
+    void StoreRbp(int32_t disp) {
+        Bytes({0x48, 0x89, 0x85});
+        Imm32(disp);
+    }
+
+private:
+    void Raw(const void* data, size_t size) {
+        auto bytes = static_cast<const uint8_t*>(data);
+        code_.insert(code_.end(), bytes, bytes + size);
+    }
+
+    std::vector<uint8_t> code_;
+};
+
+// Template compiler: every supported form expands to a fixed instruction sequence which leaves
+// its result in rax, temporaries live on the machine stack. Parameters are passed on the stack
+// as well, the first one deepest.
+class JitCompiler {
+public:
+    explicit JitCompiler(const JitProfile& profile) : profile_(profile) {
+    }
+
+    // nullptr if the lambda uses something not supported
+    std::unique_ptr<JitCode> Compile() {
+        const auto& params = profile_.GetParams();
+        if (params.size() > kMaxArgs || profile_.GetBody().size() != 1) {
+            return nullptr;
+        }
+        try {
+            EmitTrampoline();
+            EmitFunction();
+        } catch (const Unsupported&) {
+            return nullptr;
+        }
+        return std::make_unique<JitCode>(assembler_.GetCode(), std::move(guards_), params.size());
+    }
+
+private:
+    struct Unsupported {};
+
+    enum class Type { kInt, kBool };
+
+    enum class Builtin { kAdd, kSub, kMul, kLess, kGreater, kEqual, kLessEqual, kGreaterEqual,
+                         kNot };
+
+    // int entry(JitContext* context): calls the function with context->args, returns 0 on
+    // bailout and 1 with the result stored in context->result
+    void EmitTrampoline() {
+        auto arg_count = static_cast<int32_t>(profile_.GetParams().size());
+        auto& a = assembler_;
+        a.Bytes({0x55});                    // push rbp
+        a.Bytes({0x41, 0x57});              // push r15
+        a.Bytes({0x49, 0x89, 0xFF});        // mov r15, rdi
+        a.Bytes({0x49, 0x89, 0x67, 0x00});  // mov [r15 + saved_rsp], rsp
+        a.Bytes({0x49, 0x8B, 0x4F, 0x10});  // mov rcx, [r15 + args]
+        for (int32_t i = 0; i < arg_count; ++i) {
+            a.Bytes({0x48, 0x8B, 0x81});  // mov rax, [rcx + 8 * i]
+            a.Imm32(8 * i);
+            a.Bytes({0x50});  // push rax
+        }
+        self_calls_.push_back(a.Rel32({0xE8}));  // call function
+        a.Bytes({0x48, 0x81, 0xC4});             // add rsp, 8 * arg_count
+        a.Imm32(8 * arg_count);
+        a.Bytes({0x49, 0x89, 0x47, 0x18});  // mov [r15 + result], rax
+        a.Bytes({0xB8, 0x01, 0x00, 0x00, 0x00});  // mov eax, 1
+        a.Bytes({0x41, 0x5F, 0x5D, 0xC3});        // pop r15; pop rbp; ret
+
+        bailout_ = a.Here();
+        a.Bytes({0x49, 0x8B, 0x67, 0x00});  // mov rsp, [r15 + saved_rsp]
+        a.Bytes({0x31, 0xC0});              // xor eax, eax
+        a.Bytes({0x41, 0x5F, 0x5D, 0xC3});  // pop r15; pop rbp; ret
+    }
+
+    void EmitFunction() {
+        auto& a = assembler_;
+        function_ = a.Here();
+        a.Bytes({0x55});                    // push rbp
+        a.Bytes({0x48, 0x89, 0xE5});        // mov rbp, rsp
+        a.Bytes({0x49, 0x3B, 0x67, 0x08});  // cmp rsp, [r15 + stack_limit]
+        BailoutIf({0x0F, 0x82});            // jb bailout
+        body_ = a.Here();
+        if (CompileExpression(profile_.GetBody().front(), true) != Type::kInt) {
+            throw Unsupported();
+        }
+        a.Bytes({0x48, 0x89, 0xEC});  // mov rsp, rbp
+        a.Bytes({0x5D, 0xC3});        // pop rbp; ret
+
+        for (auto operand_pos : self_calls_) {
+            a.Patch(operand_pos, function_);
+        }
+    }
+
+    void BailoutIf(std::initializer_list<uint8_t> jump_opcode) {
+        assembler_.Patch(assembler_.Rel32(jump_opcode), bailout_);
+    }
+
+    int32_t ParamOffset(size_t index) const {
+        // above saved rbp and return address, the last parameter is pushed last
+        return static_cast<int32_t>(16 + 8 * (profile_.GetParams().size() - 1 - index));
+    }
+
+    Type CompileExpression(const Value& ast, bool tail) {
+        if (Is<Number>(ast)) {
+            assembler_.MovRaxImm(As<Number>(ast)->GetValue());
+            return Type::kInt;
+        }
+        if (Is<Bool>(ast)) {
+            assembler_.MovRaxImm(ast.GetBool() ? 1 : 0);
+            return Type::kBool;
+        }
+        if (Is<FoldedCall>(ast)) {
+            auto folded = As<FoldedCall>(ast);
+            const auto& guards = folded->GetGuards();
+            guards_.insert(guards_.end(), guards.begin(), guards.end());
+            return CompileExpression(folded->GetValue(), tail);
+        }
+        if (Is<Symbol>(ast)) {
+            const auto& params = profile_.GetParams();
+            auto it = std::find(params.begin(), params.end(), As<Symbol>(ast)->GetId());
+            if (it == params.end()) {
+                throw Unsupported();
+            }
+            assembler_.LoadRbp(ParamOffset(it - params.begin()));
+            return Type::kInt;
+        }
+        if (!Is<Cell>(ast)) {
+            throw Unsupported();
+        }
+
+        ObjectList form;
+        try {
+            form = ListToVector(ast, "");
+        } catch (const SyntaxError&) {
+            throw Unsupported();
+        }
+        switch (GetSpecialForm(form.front())) {
+            case SpecialForm::kIf:
+                return CompileIf(form, tail);
+            case SpecialForm::kNone:
+                return CompileCall(form, tail);
+            default:
+                throw Unsupported();
+        }
+    }
+
+    void CompileOperand(const Value& ast, Type type) {
+        if (CompileExpression(ast, false) != type) {
+            throw Unsupported();
+        }
+    }
+
+    Type CompileIf(const ObjectList& form, bool tail) {
+        if (form.size() != 4) {
+            throw Unsupported();
+        }
+        auto& a = assembler_;
+        CompileOperand(form[1], Type::kBool);
+        a.Bytes({0x48, 0x85, 0xC0});  // test rax, rax
+        auto else_jump = a.Rel32({0x0F, 0x84});  // jz else
+        auto type = CompileExpression(form[2], tail);
+        auto end_jump = a.Rel32({0xE9});  // jmp end
+        a.Patch(else_jump, a.Here());
+        if (CompileExpression(form[3], tail) != type) {
+            throw Unsupported();
+        }
+        a.Patch(end_jump, a.Here());
+        return type;
+    }
+
+    Type CompileCall(const ObjectList& form, bool tail) {
+        if (!Is<Symbol>(form.front())) {
+            throw Unsupported();
+        }
+        auto name = As<Symbol>(form.front())->GetId();
+        const auto& params = profile_.GetParams();
+        if (std::find(params.begin(), params.end(), name) != params.end()) {
+            throw Unsupported();
+        }
+        auto binding = profile_.GetGlobal()->GetBinding(name);
+        if (!binding->IsDefined()) {
+            throw Unsupported();
+        }
+        auto function = binding->Get();
+        guards_.emplace_back(binding);
+
+        if (Is<LambdaCall>(function) && As<LambdaCall>(function)->GetJitProfile() == &profile_) {
+            CompileSelfCall(form, tail);
+            return Type::kInt;
+        }
+        return CompileBuiltin(GetBuiltin(function), form);
+    }
+
+    static Builtin GetBuiltin(const Value& function) {
+        switch (function.GetType()) {
+            case ObjectType::kSum:
+                return Builtin::kAdd;
+            case ObjectType::kDif:
+                return Builtin::kSub;
+            case ObjectType::kProd:
+                return Builtin::kMul;
+            case ObjectType::kNot:
+                return Builtin::kNot;
+            case ObjectType::kLess:
+                return Builtin::kLess;
+            case ObjectType::kGreater:
+                return Builtin::kGreater;
+            case ObjectType::kEqual:
+                return Builtin::kEqual;
+            case ObjectType::kLessEqual:
+                return Builtin::kLessEqual;
+            case ObjectType::kGreaterEqual:
+                return Builtin::kGreaterEqual;
+            default:
+                throw Unsupported();
+        }
+    }
+
+    Type CompileBuiltin(Builtin builtin, const ObjectList& form) {
+        auto& a = assembler_;
+        size_t argc = form.size() - 1;
+        switch (builtin) {
+            case Builtin::kAdd:
+            case Builtin::kMul:
+                if (argc == 0) {
+                    a.MovRaxImm(builtin == Builtin::kAdd ? 0 : 1);
+                    return Type::kInt;
+                }
+                break;
+            case Builtin::kSub:
+                if (argc == 0) {
+                    throw Unsupported();
+                }
+                // like Dif, a single argument is returned unchanged
+                if (argc == 1) {
+                    CompileOperand(form[1], Type::kInt);
+                    return Type::kInt;
+                }
+                break;
+            case Builtin::kNot:
+                if (argc != 1) {
+                    throw Unsupported();
+                }
+                CompileOperand(form[1], Type::kBool);
+                a.Bytes({0x83, 0xF0, 0x01});  // xor eax, 1
+                return Type::kBool;
+            default:
+                // comparisons
+                if (argc != 2) {
+                    throw Unsupported();
+                }
+                CompileBinary(form[1], form[2]);
+                a.Bytes({0x48, 0x39, 0xC8});  // cmp rax, rcx
+                a.Bytes({0x0F, GetSetccOpcode(builtin), 0xC0});  // setcc al
+                a.Bytes({0x0F, 0xB6, 0xC0});                     // movzx eax, al
+                return Type::kBool;
+        }
+
+        CompileOperand(form[1], Type::kInt);
+        for (size_t i = 2; i < form.size(); ++i) {
+            a.Bytes({0x50});  // push rax
+            CompileOperand(form[i], Type::kInt);
+            a.Bytes({0x48, 0x89, 0xC1});  // mov rcx, rax
+            a.Bytes({0x58});              // pop rax
+            if (builtin == Builtin::kAdd) {
+                a.Bytes({0x48, 0x01, 0xC8});  // add rax, rcx
+            } else if (builtin == Builtin::kSub) {
+                a.Bytes({0x48, 0x29, 0xC8});  // sub rax, rcx
+            } else {
+                a.Bytes({0x48, 0x0F, 0xAF, 0xC1});  // imul rax, rcx
+            }
+            BailoutIf({0x0F, 0x80});  // jo bailout
+        }
+        return Type::kInt;
+    }
+
+    // leaves first operand in rax and second in rcx
+    void CompileBinary(const Value& first, const Value& second) {
+        auto& a = assembler_;
+        CompileOperand(first, Type::kInt);
+        a.Bytes({0x50});  // push rax
+        CompileOperand(second, Type::kInt);
+        a.Bytes({0x48, 0x89, 0xC1});  // mov rcx, rax
+        a.Bytes({0x58});              // pop rax
+    }
+
+    static uint8_t GetSetccOpcode(Builtin comparison) {
+        switch (comparison) {
+            case Builtin::kLess:
+                return 0x9C;  // setl
+            case Builtin::kGreater:
+                return 0x9F;  // setg
+            case Builtin::kEqual:
+                return 0x94;  // sete
+            case Builtin::kLessEqual:
+                return 0x9E;  // setle
+            default:
+                return 0x9D;  // setge
+        }
+    }
+
+    void CompileSelfCall(const ObjectList& form, bool tail) {
+        const auto& params = profile_.GetParams();
+        if (form.size() - 1 != params.size()) {
+            throw Unsupported();
+        }
+        auto& a = assembler_;
+        for (size_t i = 1; i < form.size(); ++i) {
+            CompileOperand(form[i], Type::kInt);
+            a.Bytes({0x50});  // push rax
+        }
+        if (tail) {
+            // nothing else is on the stack in tail position, so the frame is reused as is
+            for (size_t i = params.size(); i > 0; --i) {
+                a.Bytes({0x58});  // pop rax
+                a.StoreRbp(ParamOffset(i - 1));
+            }
+            a.Patch(a.Rel32({0xE9}), body_);  // jmp body
+            return;
+        }
+        self_calls_.push_back(a.Rel32({0xE8}));  // call function
+        a.Bytes({0x48, 0x81, 0xC4});             // add rsp, 8 * argc
+        a.Imm32(static_cast<int32_t>(8 * params.size()));
+    }
+
+    const JitProfile& profile_;
+    X86Assembler assembler_;
+    std::vector<BindingGuard> guards_;
+    // call operands to patch with the function address
+    std::vector<size_t> self_calls_;
+    size_t bailout_ = 0;
+    size_t function_ = 0;
+    size_t body_ = 0;
+};
+
+static std::unique_ptr<JitCode> CompileNative(const JitProfile& profile) {
+    return JitCompiler(profile).Compile();
+}
+
+#else
+
+// Other platforms never compile, every lambda stays interpreted.
+class JitCode {
+public:
+    std::optional<Value> Call(const ObjectList&, bool&) {
+        return std::nullopt;
+    }
+};
+
+static std::unique_ptr<JitCode> CompileNative(const JitProfile&) {
+    return nullptr;
+}
+
+#endif
+
+JitProfile::JitProfile(std::vector<SymbolId> params, ObjectList body,
+                       std::shared_ptr<Scope> global)
+    : params_(std::move(params)), global_(std::move(global)) {
+    // the body is compiled after its input is gone
+    for (const auto& form : body) {
+        body_.push_back(Arena::Promote(form));
+    }
+}
+
+JitProfile::~JitProfile() = default;
+
+std::optional<Value> JitProfile::TryCall(const ObjectList& args) {
+    if (!code_) {
+        if (compile_attempted_ || ++call_count_ < kHotCallCount) {
+            return std::nullopt;
+        }
+        compile_attempted_ = true;
+        code_ = CompileNative(*this);
+        if (!code_) {
+            return std::nullopt;
+        }
+    }
+    bool bailed_out = false;
+    auto result = code_->Call(args, bailed_out);
+    if (bailed_out && ++bailout_count_ > kMaxBailouts) {
+        code_.reset();
+    }
+    return result;
+}
+
+bool JitProfile::IsCompiled() const {
+    return code_ != nullptr;
+}
+
+const std::vector<SymbolId>& JitProfile::GetParams() const {
+    return params_;
+}
+
+const ObjectList& JitProfile::GetBody() const {
+    return body_;
+}
+
+const std::shared_ptr<Scope>& JitProfile::GetGlobal() const {
+    return global_;
+}
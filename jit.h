@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "object.h"
+
+class JitCode;
+
+// Call statistics and native code of one top level lambda expression, shared by its closures.
+// Once the lambda gets hot it is compiled to x86-64 machine code if its body is a single
+// expression built from integer literals, parameters, + - *, binary comparisons, 'not', 'if'
+// and calls of the lambda itself through its global name. Any other lambda stays interpreted.
+//
+// Native code runs only while the globals it relies on are unchanged and all arguments are
+// integers. Arithmetic overflow and deep recursion abandon the native call, which is side effect
+// free, and leave it to the interpreter.
+class JitProfile {
+public:
+    JitProfile(std::vector<SymbolId> params, ObjectList body, std::shared_ptr<Scope> global);
+
+    ~JitProfile();
+
+    // result of the call computed by native code, nothing if the interpreter has to run it
+    std::optional<Value> TryCall(const ObjectList& args);
+
+    bool IsCompiled() const;
+
+    const std::vector<SymbolId>& GetParams() const;
+
+    const ObjectList& GetBody() const;
+
+    const std::shared_ptr<Scope>& GetGlobal() const;
+
+    static constexpr size_t kHotCallCount = 50;
+    // native code which keeps bailing out is dropped
+    static constexpr size_t kMaxBailouts = 1000;
+
+private:
+    std::vector<SymbolId> params_;
+    ObjectList body_;
+    std::shared_ptr<Scope> global_;
+
+    size_t call_count_ = 0;
+    size_t bailout_count_ = 0;
+    bool compile_attempted_ = false;
+    std::unique_ptr<JitCode> code_;
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of a whole file. Large data files are tokenized in place, the pages
+// are loaded by the kernel as the tokenizer reaches them.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    // valid while the file is mapped
+    std::string_view GetContent() const;
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
@@ -1,174 +1,138 @@
 #include "object.h"
+#include "analyzer.h"
+#include "jit.h"
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunused-parameter"
-std::shared_ptr<Object> Dot::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Dot>();
-}
-
-std::string Dot::Serialize() {
-    return ".";
-}
-
-Number::Number(int64_t value) : value_(value) {
-}
-
-Number::Number(const Token& token) : value_(std::get<ConstantToken>(token).value) {
-}
-
-Number::Number(const Number& other) : value_(other.value_) {
-}
-
-Number::Number(Number&& other) noexcept : value_(other.value_) {
-}
-
-Number& Number::operator=(const Number& other) {
-    value_ = other.value_;
-    return *this;
-}
-
-Number& Number::operator=(Number&& other) noexcept {
-    std::swap(value_, other.value_);
-    return *this;
-}
-
-std::shared_ptr<Object> Number::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Number>(Number(*this));
+std::string Value::Serialize() const {
+    switch (GetType()) {
+        case ObjectType::kNil:
+            return "()";
+        case ObjectType::kNumber:
+            return std::to_string(GetInteger());
+        case ObjectType::kBool:
+            return GetBool() ? "#t" : "#f";
+        default:
+            return object_->Serialize();
+    }
 }
 
-std::string Number::Serialize() {
+std::string BoxedInteger::Serialize() {
     return std::to_string(value_);
 }
 
-int64_t Number::GetValue() const {
-    return value_;
-}
-
-Bool::Bool(bool inp) : value_(inp) {
-}
-
-Bool::Bool(const Token& token) : value_(std::get<Boolean>(token) == Boolean::TRUE) {
-}
-
-Bool::Bool(const Bool& other) : value_(other.value_) {
-}
-
-Bool::Bool(Bool&& other) noexcept : value_(other.value_) {
-}
-
-Bool& Bool::operator=(const Bool& other) {
-    value_ = other.value_;
-    return *this;
-}
-
-Bool& Bool::operator=(Bool&& other) noexcept {
-    value_ = other.value_;
-    return *this;
-}
-
-std::shared_ptr<Object> Bool::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Bool>(Bool(*this));
-}
-
-std::string Bool::Serialize() {
-    return value_ ? "#t" : "#f";
+std::string Dot::Serialize() {
+    return ".";
 }
 
-bool Bool::GetBool() const {
-    return value_;
+Value Function::Apply0() {
+    return ApplySpan({});
 }
 
-std::shared_ptr<Object> Quote::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Quote>();
+Value Function::Apply1(const Value& first) {
+    return ApplySpan({&first, 1});
 }
 
-std::string Quote::Serialize() {
-    return "quote";
+Value Function::Apply2(const Value& first, const Value& second) {
+    Value args[] = {first, second};
+    return ApplySpan(args);
 }
 
-std::shared_ptr<Object> Quote::Apply(const ObjectList& args) {
-    throw RuntimeError("Special form 'Quote' should never be applied");
+Value Function::Apply3(const Value& first, const Value& second, const Value& third) {
+    Value args[] = {first, second, third};
+    return ApplySpan(args);
 }
 
-std::shared_ptr<Object> IsNum::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<IsNum>();
+Value Function::ApplySpan(ArgSpan args) {
+    return Apply(ObjectList(args.begin(), args.end()));
 }
 
 std::string IsNum::Serialize() {
     return "number?";
 }
 
-std::shared_ptr<Object> IsNum::Apply(const ObjectList& args) {
+Value IsNum::Apply(const ObjectList& args) {
     if (args.size() != 1) {
         throw RuntimeError("Wrong number of argument in function 'number?'");
     }
-    return Bool(Is<Number>(args.front())).Eval(nullptr);
+    return Apply1(args.front());
 }
 
-std::shared_ptr<Object> IsBool::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<IsBool>();
+Value IsNum::Apply1(const Value& arg) {
+    return Value::Boolean(Is<Number>(arg));
 }
 
 std::string IsBool::Serialize() {
     return "boolean?";
 }
 
-std::shared_ptr<Object> IsBool::Apply(const ObjectList& args) {
+Value IsBool::Apply(const ObjectList& args) {
     if (args.size() != 1) {
         throw RuntimeError("Wrong number of argument in function 'boolean?'");
     }
-    return Bool(Is<Bool>(args.front())).Eval(nullptr);
+    return Apply1(args.front());
 }
 
-std::shared_ptr<Object> Abs::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Abs>();
+Value IsBool::Apply1(const Value& arg) {
+    return Value::Boolean(Is<Bool>(arg));
 }
 
 std::string Abs::Serialize() {
-    return "number?";
+    return "abs";
 }
 
-std::shared_ptr<Object> Abs::Apply(const ObjectList& args) {
+Value Abs::Apply(const ObjectList& args) {
     if (args.size() != 1) {
         throw RuntimeError("Wrong number of argument in function 'abs'");
     }
-    if (Is<Number>(args.front())) {
-        int64_t result = As<Number>(args.front())->GetValue();
+    return Apply1(args.front());
+}
+
+Value Abs::Apply1(const Value& arg) {
+    if (Is<Number>(arg)) {
+        int64_t result = As<Number>(arg)->GetValue();
         result = result < 0 ? -result : result;
-        return Number(result).Eval(nullptr);
+        return Value::Integer(result);
     } else {
         throw RuntimeError("'abs' function only works with numbers");
     }
 }
 
-std::shared_ptr<Object> Sum::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Sum>();
-}
-
 std::string Sum::Serialize() {
     return "+";
 }
 
-std::shared_ptr<Object> Sum::Apply(const ObjectList& args) {
+Value Sum::Apply(const ObjectList& args) {
+    return ApplySpan(args);
+}
+
+Value Sum::ApplySpan(ArgSpan args) {
     int64_t sum = 0;
-    for (auto ptr : args) {
+    for (const auto& ptr : args) {
         if (!Is<Number>(ptr)) {
             throw RuntimeError("Wrong type argument in '+' operator");
         }
         sum += As<Number>(ptr)->GetValue();
     }
-    return std::make_shared<Number>(sum);
+    return Value::Integer(sum);
 }
 
-std::shared_ptr<Object> Dif::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Dif>();
+Value Sum::Apply2(const Value& first, const Value& second) {
+    if (!Is<Number>(first) || !Is<Number>(second)) {
+        throw RuntimeError("Wrong type argument in '+' operator");
+    }
+    return Value::Integer(first.GetInteger() + second.GetInteger());
 }
 
 std::string Dif::Serialize() {
     return "-";
 }
 
-std::shared_ptr<Object> Dif::Apply(const ObjectList& args) {
+Value Dif::Apply(const ObjectList& args) {
+    return ApplySpan(args);
+}
+
+Value Dif::ApplySpan(ArgSpan args) {
     if (args.empty()) {
         throw RuntimeError("Can't apply operator '-' without args");
     }
@@ -183,37 +147,51 @@ std::shared_ptr<Object> Dif::Apply(const ObjectList& args) {
         }
         dif -= As<Number>(args[i])->GetValue();
     }
-    return std::make_shared<Number>(dif);
+    return Value::Integer(dif);
 }
 
-std::shared_ptr<Object> Prod::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Prod>();
+Value Dif::Apply2(const Value& first, const Value& second) {
+    if (!Is<Number>(first) || !Is<Number>(second)) {
+        throw RuntimeError("Wrong type argument in '-' operator");
+    }
+    return Value::Integer(first.GetInteger() - second.GetInteger());
 }
 
 std::string Prod::Serialize() {
     return "*";
 }
 
-std::shared_ptr<Object> Prod::Apply(const ObjectList& args) {
+Value Prod::Apply(const ObjectList& args) {
+    return ApplySpan(args);
+}
+
+Value Prod::ApplySpan(ArgSpan args) {
     int64_t prod = 1;
-    for (auto ptr : args) {
+    for (const auto& ptr : args) {
         if (!Is<Number>(ptr)) {
             throw RuntimeError("Wrong type argument in '*' operator");
         }
         prod *= As<Number>(ptr)->GetValue();
     }
-    return std::make_shared<Number>(prod);
+    return Value::Integer(prod);
 }
 
-std::shared_ptr<Object> Div::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Div>();
+Value Prod::Apply2(const Value& first, const Value& second) {
+    if (!Is<Number>(first) || !Is<Number>(second)) {
+        throw RuntimeError("Wrong type argument in '*' operator");
+    }
+    return Value::Integer(first.GetInteger() * second.GetInteger());
 }
 
 std::string Div::Serialize() {
     return "/";
 }
 
-std::shared_ptr<Object> Div::Apply(const ObjectList& args) {
+Value Div::Apply(const ObjectList& args) {
+    return ApplySpan(args);
+}
+
+Value Div::ApplySpan(ArgSpan args) {
     if (args.empty()) {
         throw RuntimeError("Can't apply operator '/' without args");
     }
@@ -228,18 +206,18 @@ std::shared_ptr<Object> Div::Apply(const ObjectList& args) {
         }
         div /= As<Number>(args[i])->GetValue();
     }
-    return std::make_shared<Number>(div);
-}
-
-std::shared_ptr<Object> Min::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Min>();
+    return Value::Integer(div);
 }
 
 std::string Min::Serialize() {
     return "min";
 }
 
-std::shared_ptr<Object> Min::Apply(const ObjectList& args) {
+Value Min::Apply(const ObjectList& args) {
+    return ApplySpan(args);
+}
+
+Value Min::ApplySpan(ArgSpan args) {
     if (args.empty()) {
         throw RuntimeError("Can't apply 'min' function without args");
     }
@@ -254,18 +232,18 @@ std::shared_ptr<Object> Min::Apply(const ObjectList& args) {
         }
         min = std::min(min, As<Number>(args[i])->GetValue());
     }
-    return std::make_shared<Number>(min);
-}
-
-std::shared_ptr<Object> Max::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Max>();
+    return Value::Integer(min);
 }
 
 std::string Max::Serialize() {
     return "max";
 }
 
-std::shared_ptr<Object> Max::Apply(const ObjectList& args) {
+Value Max::Apply(const ObjectList& args) {
+    return ApplySpan(args);
+}
+
+Value Max::ApplySpan(ArgSpan args) {
     if (args.empty()) {
         throw RuntimeError("Can't apply 'max' function without args");
     }
@@ -280,16 +258,29 @@ std::shared_ptr<Object> Max::Apply(const ObjectList& args) {
         }
         max = std::max(max, As<Number>(args[i])->GetValue());
     }
-    return std::make_shared<Number>(max);
+    return Value::Integer(max);
+}
+
+static ObjectType GetComparisonType(const std::string& name) {
+    static const std::unordered_map<std::string, ObjectType> kTypes = {
+        {"=", ObjectType::kEqual},
+        {"<", ObjectType::kLess},
+        {">", ObjectType::kGreater},
+        {"<=", ObjectType::kLessEqual},
+        {">=", ObjectType::kGreaterEqual}};
+    return kTypes.at(name);
 }
 
-Comp::Comp(std::string inp) : comp_(get_lambda[inp]), type_(inp) {
+Comp::Comp(std::string inp)
+    : Function(GetComparisonType(inp)), comp_(get_lambda[inp]), type_(inp) {
 }
 
-Comp::Comp(const Comp& other) : comp_(other.comp_), type_(other.type_) {
+Comp::Comp(const Comp& other)
+    : Function(other.GetType()), comp_(other.comp_), type_(other.type_) {
 }
 
-Comp::Comp(Comp&& other) noexcept : comp_(other.comp_), type_(std::move(other.type_)) {
+Comp::Comp(Comp&& other) noexcept
+    : Function(other.GetType()), comp_(other.comp_), type_(std::move(other.type_)) {
     other.comp_ = nullptr;
 }
 
@@ -306,17 +297,17 @@ Comp& Comp::operator=(Comp&& other) noexcept {
     return *this;
 }
 
-std::shared_ptr<Object> Comp::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Comp>(Comp(type_));
-}
-
 std::string Comp::Serialize() {
     return type_;
 }
 
-std::shared_ptr<Object> Comp::Apply(const ObjectList& args) {
+Value Comp::Apply(const ObjectList& args) {
+    return ApplySpan(args);
+}
+
+Value Comp::ApplySpan(ArgSpan args) {
     if (args.empty()) {
-        return std::make_shared<Bool>(true);
+        return Value::Boolean(true);
     }
 
     if (!Is<Number>(args.front())) {
@@ -328,444 +319,356 @@ std::shared_ptr<Object> Comp::Apply(const ObjectList& args) {
             throw RuntimeError("Wrong type argument in compare operator");
         }
         if (!comp_(As<Number>(args[i - 1])->GetValue(), As<Number>(args[i])->GetValue())) {
-            return std::make_shared<Bool>(false);
+            return Value::Boolean(false);
         }
     }
-    return std::make_shared<Bool>(true);
+    return Value::Boolean(true);
 }
 
-std::shared_ptr<Object> Not::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Not>();
+Value Comp::Apply2(const Value& first, const Value& second) {
+    if (!Is<Number>(first) || !Is<Number>(second)) {
+        throw RuntimeError("Wrong type argument in compare operator");
+    }
+    return Value::Boolean(comp_(first.GetInteger(), second.GetInteger()));
 }
 
 std::string Not::Serialize() {
     return "not";
 }
 
-std::shared_ptr<Object> Not::Apply(const ObjectList& args) {
+Value Not::Apply(const ObjectList& args) {
     if (args.size() != 1) {
         throw RuntimeError("Wrong number of argument in 'not' operator");
     }
-    bool arg_bool_val = !Is<Bool>(args.front()) || As<Bool>(args.front())->GetBool();
-    return std::make_shared<Bool>(!arg_bool_val);
-}
-
-std::shared_ptr<Object> And::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<And>();
-}
-
-std::string And::Serialize() {
-    return "and";
-}
-
-std::shared_ptr<Object> And::Apply(const ObjectList& args) {
-    if (args.empty()) {
-        return std::make_shared<Bool>(true);
-    }
-
-    bool expression_result = true;
-    for (size_t i = 0; i < args.size() - 1; ++i) {
-        bool arg_bool_val = !Is<Bool>(args.front()) || As<Bool>(args.front())->GetBool();
-        expression_result &= arg_bool_val;
-    }
-
-    return expression_result ? args.back() : std::make_shared<Bool>(false);
+    return Apply1(args.front());
 }
 
-std::shared_ptr<Object> Or::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Or>();
+Value Not::Apply1(const Value& arg) {
+    return Value::Boolean(!IsTrue(arg));
 }
 
-std::string Or::Serialize() {
-    return "or";
+Cell::Cell(Value first, Value second)
+    : Object(ObjectType::kCell),
+      GcNode(this),
+      first_(std::move(first)),
+      second_(std::move(second)) {
 }
 
-std::shared_ptr<Object> Or::Apply(const ObjectList& args) {
-    if (args.empty()) {
-        return std::make_shared<Bool>(false);
-    }
-
-    bool expression_result = true;
-    for (size_t i = 0; i < args.size() - 1; ++i) {
-        bool arg_bool_val = !Is<Bool>(args.front()) || As<Bool>(args.front())->GetBool();
-        expression_result |= arg_bool_val;
+Cell::~Cell() {
+    // frees the rest of the list in a loop, recursion as deep as the list overflows the stack
+    auto tail = std::move(second_);
+    while (Is<Cell>(tail) && tail.IsUnique()) {
+        tail = std::move(As<Cell>(tail)->second_);
     }
-
-    return expression_result ? args.back() : std::make_shared<Bool>(false);
-}
-
-void Cell::SetExterior(bool is_exterior) {
-    is_exterior_ = is_exterior;
 }
 
-void Cell::SetFirst(const std::shared_ptr<Object>& first) {
+void Cell::SetFirst(const Value& first) {
     first_ = first;
 }
 
-void Cell::SetSecond(const std::shared_ptr<Object>& second) {
+void Cell::SetSecond(const Value& second) {
     second_ = second;
 }
 
-std::shared_ptr<Object> Cell::GetFirst() const {
+const Value& Cell::GetFirst() const {
     return first_;
 }
 
-std::shared_ptr<Object> Cell::GetSecond() const {
+const Value& Cell::GetSecond() const {
     return second_;
 }
 
-bool Cell::IsExterior() {
-    return is_exterior_;
+void Cell::Trace(std::vector<GcNode*>& children) {
+    TraceValue(first_, children);
+    TraceValue(second_, children);
 }
 
-std::shared_ptr<Object> Cell::Eval(std::shared_ptr<Scope> scope) {
-    auto cell = std::make_shared<Cell>();
-    cell->SetExterior(is_exterior_);
-
-    if (first_.get()) {
-        cell->SetFirst(first_->Eval(scope));
-    }
-    if (second_.get()) {
-        cell->SetSecond(second_->Eval(scope));
-    }
-    return cell;
+void Cell::Clear() {
+    first_ = Value();
+    second_ = Value();
 }
 
 std::string Cell::Serialize() {
-    std::string serialization_result;
-    std::string sep =
-        (first_.get() && !Is<Cell>(first_) && second_.get() && !Is<Cell>(second_)) ? " . " : " ";
-
-    if (first_.get()) {
-        serialization_result = first_->Serialize();
-    } else {
-        serialization_result = "()";
+    // walks the list through plain pointers, the traversal doesn't touch reference counts
+    std::string serialization_result = "(";
+    serialization_result += first_.Serialize();
+    const Value* tail = &second_;
+    while (Is<Cell>(*tail)) {
+        serialization_result += ' ';
+        serialization_result += As<Cell>(*tail)->GetFirst().Serialize();
+        tail = &As<Cell>(*tail)->GetSecond();
     }
-
-    if (second_.get()) {
-        serialization_result += sep + second_->Serialize();
+    if (*tail) {
+        serialization_result += " . ";
+        serialization_result += tail->Serialize();
     }
-    return is_exterior_ ? "(" + serialization_result + ")" : serialization_result;
-}
-
-std::shared_ptr<Object> IsPair::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<IsPair>();
+    serialization_result += ')';
+    return serialization_result;
 }
 
 std::string IsPair::Serialize() {
     return "pair?";
 }
 
-std::shared_ptr<Object> IsPair::Apply(const ObjectList& args) {
+Value IsPair::Apply(const ObjectList& args) {
     if (args.size() != 1) {
         throw RuntimeError("Wrong number of argument in function 'pair?'");
     }
-
-    if (!Is<Cell>(args.front())) {
-        return std::make_shared<Bool>(false);
-    }
-
-    std::shared_ptr<Object> first = As<Cell>(args.front())->GetFirst();
-    std::shared_ptr<Object> second = As<Cell>(args.front())->GetSecond();
-
-    // check for (1 . 2)
-    bool is_dot_pair = first.get() && !Is<Cell>(first) && second.get() && !Is<Cell>(second);
-    if (is_dot_pair) {
-        return std::make_shared<Bool>(true);
-    }
-
-    // check for (1 2) aka (1 (2 ()))
-    bool is_list_pair = first.get() && !Is<Cell>(first) && second.get() && Is<Cell>(second) &&
-                        As<Cell>(second)->GetFirst().get() &&
-                        !Is<Cell>(As<Cell>(second)->GetFirst()) &&
-                        !As<Cell>(second)->GetSecond().get();
-    return std::make_shared<Bool>(is_list_pair);
+    return Apply1(args.front());
 }
 
-std::shared_ptr<Object> IsNull::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<IsNull>();
+Value IsPair::Apply1(const Value& arg) {
+    return Value::Boolean(Is<Cell>(arg));
 }
 
 std::string IsNull::Serialize() {
     return "null?";
 }
 
-std::shared_ptr<Object> IsNull::Apply(const ObjectList& args) {
+Value IsNull::Apply(const ObjectList& args) {
     if (args.size() != 1) {
         throw RuntimeError("Wrong number of argument in function 'null?'");
     }
-
-    if (!Is<Cell>(args.front())) {
-        return std::make_shared<Bool>(false);
-    }
-
-    std::shared_ptr<Object> first = As<Cell>(args.front())->GetFirst();
-    std::shared_ptr<Object> second = As<Cell>(args.front())->GetSecond();
-
-    return std::make_shared<Bool>(!first.get() && !second.get());
+    return Apply1(args.front());
 }
 
-std::shared_ptr<Object> IsList::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<IsList>();
+Value IsNull::Apply1(const Value& arg) {
+    return Value::Boolean(!arg);
 }
 
 std::string IsList::Serialize() {
     return "list?";
 }
 
-std::shared_ptr<Object> IsList::Apply(const ObjectList& args) {
+Value IsList::Apply(const ObjectList& args) {
     if (args.size() != 1) {
         throw RuntimeError("Wrong number of argument in function 'list?'");
     }
-    if (!Is<Cell>(args.front())) {
-        return std::make_shared<Bool>(false);
-    }
-    return std::make_shared<Bool>(RecursiveCheck(args.front()));
+    return Apply1(args.front());
 }
 
-bool IsList::RecursiveCheck(std::shared_ptr<Object> ast) {
-    if (!Is<Cell>(ast)) {
-        return false;
+Value IsList::Apply1(const Value& arg) {
+    const Value* list = &arg;
+    while (Is<Cell>(*list)) {
+        list = &As<Cell>(*list)->GetSecond();
     }
-
-    std::shared_ptr<Object> first = As<Cell>(ast)->GetFirst();
-    std::shared_ptr<Object> second = As<Cell>(ast)->GetSecond();
-
-    if (!first.get()) {
-        return !second.get();
-    }
-    if (Is<Cell>(first)) {
-        return false;
-    }
-    if (!second.get()) {
-        return true;
-    }
-    return Is<Cell>(second) && RecursiveCheck(second);
-}
-
-std::shared_ptr<Object> Cons::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Cons>();
+    return Value::Boolean(!*list);
 }
 
 std::string Cons::Serialize() {
     return "cons";
 }
 
-std::shared_ptr<Object> Cons::Apply(const ObjectList& args) {
+Value Cons::Apply(const ObjectList& args) {
     if (args.size() != 2) {
         throw RuntimeError("Wrong number of argument in function 'cons'");
     }
-    auto cell = std::make_shared<Cell>();
-    cell->SetExterior(true);
-    cell->SetFirst(args.front());
-    cell->SetSecond(args.back());
-    return cell;
+    return Apply2(args.front(), args.back());
 }
 
-std::shared_ptr<Object> Car::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Car>();
+Value Cons::Apply2(const Value& first, const Value& second) {
+    return MakeRef<Cell>(first, second);
 }
 
 std::string Car::Serialize() {
     return "car";
 }
 
-std::shared_ptr<Object> Car::Apply(const ObjectList& args) {
+Value Car::Apply(const ObjectList& args) {
     if (args.size() != 1) {
         throw RuntimeError("Wrong number of argument in function 'car'");
     }
-    if (!Is<Cell>(args.front())) {
-        throw RuntimeError("Wrong type argument in function 'car'");
-    }
-    if (!As<Cell>(args.front())->GetFirst().get()) {
-        throw RuntimeError("Empty list can't be used as function 'car' argument");
-    }
-    return As<Cell>(args.front())->GetFirst();
+    return Apply1(args.front());
 }
 
-std::shared_ptr<Object> Cdr::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Cdr>();
+Value Car::Apply1(const Value& arg) {
+    if (!arg) {
+        throw RuntimeError("Empty list can't be used as function 'car' argument");
+    }
+    if (!Is<Cell>(arg)) {
+        throw RuntimeError("Wrong type argument in function 'car'");
+    }
+    return As<Cell>(arg)->GetFirst();
 }
 
 std::string Cdr::Serialize() {
     return "cdr";
 }
 
-std::shared_ptr<Object> Cdr::Apply(const ObjectList& args) {
+Value Cdr::Apply(const ObjectList& args) {
     if (args.size() != 1) {
         throw RuntimeError("Wrong number of argument in function 'cdr'");
     }
+    return Apply1(args.front());
+}
 
-    if (!Is<Cell>(args.front())) {
-        throw RuntimeError("Wrong type argument in function 'cdr'");
-    }
-
-    if (!As<Cell>(args.front())->GetFirst().get()) {
+Value Cdr::Apply1(const Value& arg) {
+    if (!arg) {
         throw RuntimeError("Empty list can't be used as function 'cdr' argument");
     }
-
-    if (!As<Cell>(args.front())->GetSecond().get()) {
-        return std::make_shared<Cell>();
-    }
-
-    std::shared_ptr<Object> second = As<Cell>(args.front())->GetSecond();
-    if (Is<Cell>(second)) {
-        As<Cell>(second)->SetExterior(true);
+    if (!Is<Cell>(arg)) {
+        throw RuntimeError("Wrong type argument in function 'cdr'");
     }
-    return second;
-}
-
-std::shared_ptr<Object> List::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<List>();
+    return As<Cell>(arg)->GetSecond();
 }
 
 std::string List::Serialize() {
     return "list";
 }
 
-std::shared_ptr<Object> List::Apply(const ObjectList& args) {
-    if (args.empty()) {
-        return std::make_shared<Cell>();
-    }
-
-    auto resulting_list = std::make_shared<Cell>();
-    resulting_list->SetExterior(true);
-
-    resulting_list->SetFirst(args.front());
-    RecursiveListContraction(args, 1, resulting_list);
-    return resulting_list;
+Value List::Apply(const ObjectList& args) {
+    return ApplySpan(args);
 }
 
-void List::RecursiveListContraction(const ObjectList& args, size_t ind,
-                                    std::shared_ptr<Cell>& last_cell) {
-    if (ind == args.size()) {
-        return;
+Value List::ApplySpan(ArgSpan args) {
+    Value list;
+    for (auto it = args.rbegin(); it != args.rend(); ++it) {
+        list = MakeRef<Cell>(*it, std::move(list));
     }
-
-    auto cur_cell = std::make_shared<Cell>();
-    cur_cell->SetFirst(args[ind]);
-    last_cell->SetSecond(cur_cell);
-
-    RecursiveListContraction(args, ind + 1, cur_cell);
-}
-
-std::shared_ptr<Object> ListRef::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<ListRef>();
+    return list;
 }
 
 std::string ListRef::Serialize() {
     return "list-ref";
 }
 
-std::shared_ptr<Object> ListRef::Apply(const ObjectList& args) {
+Value ListRef::Apply(const ObjectList& args) {
     if (args.size() != 2) {
         throw RuntimeError("Wrong number of argument in function 'list-ref'");
     }
-    return RecursiveListSearch(args.front(), As<Number>(args.back())->GetValue());
+    return Apply2(args.front(), args.back());
 }
 
-std::shared_ptr<Object> ListRef::RecursiveListSearch(std::shared_ptr<Object> list, const size_t ind,
-                                                     size_t cur_step) {
-    if (!Is<Cell>(list)) {
-        throw RuntimeError("Wrong type argument in function 'list-ref'");
+Value ListRef::Apply2(const Value& first, const Value& second) {
+    if (!Is<Number>(second) || As<Number>(second)->GetValue() < 0) {
+        throw RuntimeError("Wrong index argument in function 'list-ref'");
     }
-    if (ind == cur_step) {
-        return As<Cell>(list)->GetFirst();
+    const Value* list = &first;
+    for (auto ind = As<Number>(second)->GetValue(); ind > 0; --ind) {
+        if (!Is<Cell>(*list)) {
+            break;
+        }
+        list = &As<Cell>(*list)->GetSecond();
     }
-    if (!As<Cell>(list)->GetSecond().get()) {
+    if (!*list) {
         throw RuntimeError("Index out of range");
     }
-    return RecursiveListSearch(As<Cell>(list)->GetSecond(), ind, cur_step + 1);
-}
-
-std::shared_ptr<Object> ListTail::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<ListTail>();
+    if (!Is<Cell>(*list)) {
+        throw RuntimeError("Wrong type argument in function 'list-ref'");
+    }
+    return As<Cell>(*list)->GetFirst();
 }
 
 std::string ListTail::Serialize() {
     return "list-tail";
 }
 
-std::shared_ptr<Object> ListTail::Apply(const ObjectList& args) {
+Value ListTail::Apply(const ObjectList& args) {
     if (args.size() != 2) {
         throw RuntimeError("Wrong number of argument in function 'list-tail'");
     }
-    return RecursiveListSearch(args.front(), As<Number>(args.back())->GetValue());
+    return Apply2(args.front(), args.back());
 }
 
-std::shared_ptr<Object> ListTail::RecursiveListSearch(std::shared_ptr<Object> list,
-                                                      const size_t ind, size_t cur_step) {
-    if (!list.get()) {
-        if (ind == cur_step) {
-            return std::make_shared<Cell>();
+Value ListTail::Apply2(const Value& first, const Value& second) {
+    if (!Is<Number>(second) || As<Number>(second)->GetValue() < 0) {
+        throw RuntimeError("Wrong index argument in function 'list-tail'");
+    }
+    const Value* list = &first;
+    for (auto ind = As<Number>(second)->GetValue(); ind > 0; --ind) {
+        if (!*list) {
+            throw RuntimeError("Index out of range");
         }
-        throw RuntimeError("Index out of range");
+        if (!Is<Cell>(*list)) {
+            throw RuntimeError("Wrong type argument in function 'list-tail'");
+        }
+        list = &As<Cell>(*list)->GetSecond();
     }
+    return *list;
+}
 
-    if (!Is<Cell>(list)) {
-        throw RuntimeError("Wrong type argument in function 'list-ref'");
+std::string CollectGarbage::Serialize() {
+    return "gc";
+}
+
+Value CollectGarbage::Apply(const ObjectList& args) {
+    if (!args.empty()) {
+        throw RuntimeError("Wrong number of argument in function 'gc'");
     }
+    auto heap = Heap::Current();
+    return Value::Integer(heap ? heap->Collect() : 0);
+}
+
+std::string MemoryStats::Serialize() {
+    return "memory-stats";
+}
 
-    if (ind == cur_step) {
-        As<Cell>(list)->SetExterior(true);
-        return list;
+Value MemoryStats::Apply(const ObjectList& args) {
+    if (!args.empty()) {
+        throw RuntimeError("Wrong number of argument in function 'memory-stats'");
+    }
+    auto heap = Heap::Current();
+    auto stats = heap ? heap->GetStats() : HeapStats{};
+    std::pair<const char*, size_t> figures[] = {{"allocated", stats.allocated_bytes},
+                                                {"live", stats.live_bytes},
+                                                {"peak", stats.peak_bytes},
+                                                {"limit", stats.limit_bytes}};
+    Value result;
+    for (auto it = std::rbegin(figures); it != std::rend(figures); ++it) {
+        auto entry = MakeRef<Cell>(MakeRef<Symbol>(it->first), Value::Integer(it->second));
+        result = MakeRef<Cell>(std::move(entry), std::move(result));
     }
-    return RecursiveListSearch(As<Cell>(list)->GetSecond(), ind, cur_step + 1);
+    return result;
 }
 
-Symbol::Symbol(const std::string& str) : str_(str) {
+Symbol::Symbol(std::string_view str) : Object(ObjectType::kSymbol), symbol_(InternSymbol(str)) {
 }
 
-Symbol::Symbol(const Token& token) : str_(std::get<SymbolToken>(token).name) {
+Symbol::Symbol(const Token& token)
+    : Object(ObjectType::kSymbol), symbol_(std::get<SymbolToken>(token).symbol) {
 }
 
-Symbol::Symbol(const Symbol& other) : str_(other.str_) {
+Symbol::Symbol(const Symbol& other) : Object(ObjectType::kSymbol), symbol_(other.symbol_) {
 }
 
-Symbol::Symbol(Symbol&& other) noexcept : str_(move(other.str_)) {
+Symbol::Symbol(Symbol&& other) noexcept
+    : Object(ObjectType::kSymbol), symbol_(other.symbol_) {
 }
 
 Symbol& Symbol::operator=(const Symbol& other) {
-    str_ = other.str_;
+    symbol_ = other.symbol_;
     return *this;
 }
 
 Symbol& Symbol::operator=(Symbol&& other) noexcept {
-    str_ = move(other.str_);
+    symbol_ = other.symbol_;
     return *this;
 }
 
-std::shared_ptr<Object> Symbol::Eval(std::shared_ptr<Scope> scope) {
-    if (!scope.get()) {
-        return std::make_shared<Symbol>(*this);
-    }
-    return scope->ResolveSymbol(str_);
-}
-
 std::string Symbol::Serialize() {
-    return str_;
+    return symbol_->name;
 }
 const std::string& Symbol::GetName() const {
-    return str_;
+    return symbol_->name;
 }
 
-Scope::Scope(StringFuncMap&& inp, std::shared_ptr<Scope> par_scope) noexcept
-    : parent_scope_(par_scope), scope_(inp) {
+SymbolId Symbol::GetId() const {
+    return symbol_->id;
 }
 
-bool Scope::DefineSymbol(const std::string& symbol, std::shared_ptr<Object> ptr) {
-    scope_[symbol] = ptr;
-    return true;
+void Binding::Set(Value value) {
+    if (value_.IsUnbound()) {
+        throw NameError("No variable with such name in any scope");
+    }
+    value_ = std::move(value);
+    ++version_;
 }
 
-std::shared_ptr<Object> Scope::ResolveSymbol(const std::string& symbol) {
-    if (scope_.contains(symbol)) {
-        return scope_[symbol];
-    }
-    if (!parent_scope_.get()) {
-        throw NameError("SymbolsAreNotSelfEvaluating");
+Scope::Scope(StringFuncMap&& inp, std::shared_ptr<Scope> par_scope) noexcept
+    : parent_scope_(par_scope) {
+    for (auto& [name, value] : inp) {
+        scope_[InternSymbol(name)->id].Define(std::move(value));
     }
-    return parent_scope_->ResolveSymbol(symbol);
 }
 
 Scope::Scope(const Scope& other) : parent_scope_(other.parent_scope_), scope_(other.scope_) {
@@ -787,165 +690,278 @@ Scope& Scope::operator=(Scope&& other) noexcept {
     return *this;
 }
 
-void Scope::SetSymbol(const std::string& symbol, std::shared_ptr<Object> ptr) {
-    if (scope_.contains(symbol)) {
-        scope_[symbol] = ptr;
-        return;
-    }
-    if (parent_scope_.get()) {
-        parent_scope_->SetSymbol(symbol, ptr);
-        return;
+Binding* Scope::FindBinding(SymbolId symbol) {
+    for (auto scope = this; scope; scope = scope->parent_scope_.get()) {
+        if (auto it = scope->scope_.find(symbol); it != scope->scope_.end()) {
+            return &it->second;
+        }
     }
-    throw NameError("No variable with such name in any scope");
+    return nullptr;
 }
 
-bool Scope::HasSymbol(const std::string& symbol) {
-    if (scope_.contains(symbol)) {
-        return true;
+Binding* Scope::GetBinding(SymbolId symbol) {
+    if (auto binding = FindBinding(symbol)) {
+        return binding;
     }
-    if (parent_scope_.get()) {
-        return parent_scope_->HasSymbol(symbol);
-    }
-    return false;
+    return &scope_[symbol];
 }
 
-std::shared_ptr<Scope> Scope::MakeCopy() {
-    return std::make_shared<Scope>(*this);
+bool Scope::DefineSymbol(SymbolId symbol, Value ptr) {
+    // rebinds the visible binding, so that code which has already resolved it sees the new value
+    GetBinding(symbol)->Define(std::move(ptr));
+    return true;
 }
 
-std::shared_ptr<Object> If::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<If>();
+Value Scope::ResolveSymbol(SymbolId symbol) {
+    auto binding = FindBinding(symbol);
+    if (!binding) {
+        throw NameError("SymbolsAreNotSelfEvaluating");
+    }
+    return binding->Get();
 }
 
-std::string If::Serialize() {
-    return "if";
+void Scope::SetSymbol(SymbolId symbol, Value ptr) {
+    auto binding = FindBinding(symbol);
+    if (!binding) {
+        throw NameError("No variable with such name in any scope");
+    }
+    binding->Set(std::move(ptr));
 }
 
-std::shared_ptr<Object> If::Apply(const ObjectList& args) {
-    throw RuntimeError("Special form 'If' should never be applied");
+bool Scope::HasSymbol(SymbolId symbol) {
+    auto binding = FindBinding(symbol);
+    return binding && binding->IsDefined();
 }
 
-std::shared_ptr<Object> Define::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Define>();
+void Scope::UnbindAll() {
+    for (auto& [symbol, binding] : scope_) {
+        binding.Define(Value::Unbound());
+    }
+}
+
+Environment::Environment(size_t size, Ref<Environment> parent)
+    : GcNode(this), slots_(size, Value::Unbound()), parent_(std::move(parent)) {
 }
 
-std::string Define::Serialize() {
-    return "define";
+static constexpr size_t kFramePoolSize = 256;
+
+static std::vector<Ref<Environment>>& FramePool() {
+    thread_local std::vector<Ref<Environment>> pool;
+    return pool;
 }
 
-std::shared_ptr<Object> Define::Apply(const ObjectList& args) {
-    throw RuntimeError("Special form 'Define' should never be applied");
+Ref<Environment> Environment::Make(size_t size, Ref<Environment> parent) {
+    // a call is a safe point for the collector, the caller owns everything it still uses
+    auto heap = Heap::Current();
+    if (heap) {
+        heap->MaybeCollect();
+    }
+    auto& pool = FramePool();
+    if (pool.empty()) {
+        return MakeRef<Environment>(size, std::move(parent));
+    }
+    // pooled frames are charged to no heap, the one taking a frame pays for it like for a new one
+    if (heap) {
+        heap->Charge(sizeof(Environment));
+    }
+    auto env = std::move(pool.back());
+    pool.pop_back();
+    env->is_charged_ = heap != nullptr;
+    env->Attach(env.Get());
+    env->slots_.assign(size, Value::Unbound());
+    env->parent_ = std::move(parent);
+    return env;
 }
 
-std::shared_ptr<Object> Set::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<Set>();
+void Environment::Recycle(Ref<Environment>& env) {
+    auto& pool = FramePool();
+    if (env && env->GetRefCount() == 1 && pool.size() < kFramePoolSize) {
+        env->slots_.clear();
+        env->parent_ = nullptr;
+        if (auto heap = Heap::Current(); heap && env->is_charged_) {
+            heap->Credit(sizeof(Environment));
+        }
+        env->is_charged_ = false;
+        pool.push_back(std::move(env));
+    }
+    env = nullptr;
 }
 
-std::string Set::Serialize() {
-    return "set!";
+void Environment::Trace(std::vector<GcNode*>& children) {
+    for (const auto& value : slots_) {
+        TraceValue(value, children);
+    }
+    if (parent_) {
+        children.push_back(parent_.Get());
+    }
 }
 
-std::shared_ptr<Object> Set::Apply(const ObjectList& args) {
-    throw RuntimeError("Special form 'Define' should never be applied");
+void Environment::Clear() {
+    slots_.clear();
+    parent_ = nullptr;
 }
 
-std::shared_ptr<Object> SetCdr::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<SetCdr>();
+Value& Environment::Slot(int32_t depth, int32_t slot) {
+    auto env = this;
+    for (; depth > 0; --depth) {
+        env = env->parent_.Get();
+    }
+    return env->slots_[slot];
 }
 
 std::string SetCdr::Serialize() {
     return "set-cdr!";
 }
 
-std::shared_ptr<Object> SetCdr::Apply(const ObjectList& args) {
-    throw RuntimeError("Special form 'set-cdr!' should never be applied");
+Value SetCdr::Apply(const ObjectList& args) {
+    if (args.size() != 2) {
+        throw RuntimeError("Wrong number of argument in function 'set-cdr!'");
+    }
+    return Apply2(args.front(), args.back());
 }
 
-std::shared_ptr<Object> SetCar::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<SetCar>();
+Value SetCdr::Apply2(const Value& first, const Value& second) {
+    if (!Is<Cell>(first)) {
+        throw RuntimeError("Wrong type argument in function 'set-cdr!'");
+    }
+    As<Cell>(first)->SetSecond(second);
+    return Value();
 }
 
 std::string SetCar::Serialize() {
     return "set-car!";
 }
 
-std::shared_ptr<Object> SetCar::Apply(const ObjectList& args) {
-    throw RuntimeError("Special form 'set-car!' should never be applied");
+Value SetCar::Apply(const ObjectList& args) {
+    if (args.size() != 2) {
+        throw RuntimeError("Wrong number of argument in function 'set-car!'");
+    }
+    return Apply2(args.front(), args.back());
 }
 
-std::shared_ptr<Object> IsSymbol::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<IsSymbol>();
+Value SetCar::Apply2(const Value& first, const Value& second) {
+    if (!Is<Cell>(first)) {
+        throw RuntimeError("Wrong type argument in function 'set-car!'");
+    }
+    As<Cell>(first)->SetFirst(second);
+    return Value();
 }
 
 std::string IsSymbol::Serialize() {
     return "symbol?";
 }
 
-std::shared_ptr<Object> IsSymbol::Apply(const ObjectList& args) {
+Value IsSymbol::Apply(const ObjectList& args) {
     if (args.size() != 1) {
         throw RuntimeError("Wrong number of argument in function 'number?'");
     }
-    return Bool(Is<Symbol>(args.front())).Eval(nullptr);
+    return Apply1(args.front());
 }
 
-std::shared_ptr<Object> LambdaCall::Apply(const ObjectList& args) {
-    if (args.size() != args_.size()) {
-        throw RuntimeError("Wrong number of arguments in 'Lambda' function");
-    }
-    my_scope_ = my_scope_->MakeCopy();
-    for (size_t i = 0; i < args.size(); ++i) {
-        my_scope_->SetSymbol(args_[i]->GetName(), args[i]);
-    }
-    for (size_t i = 0; i < body_instructions_.size() - 1; ++i) {
-        ParseTree(body_instructions_[i], my_scope_, false);
+Value IsSymbol::Apply1(const Value& arg) {
+    return Value::Boolean(Is<Symbol>(arg));
+}
+
+Value LambdaCall::Apply(const ObjectList& args) {
+    // tail calls replace the running lambda instead of nesting Apply
+    TailCall tail{.function = nullptr, .args = args};
+    Value running;
+    auto lambda = this;
+    while (true) {
+        if (tail.args.size() != lambda->arg_count_) {
+            throw RuntimeError("Wrong number of arguments in 'Lambda' function");
+        }
+        if (lambda->jit_profile_) {
+            if (auto result = lambda->jit_profile_->TryCall(tail.args)) {
+                return std::move(*result);
+            }
+        }
+        auto env = Environment::Make(lambda->local_count_, lambda->env_);
+        for (size_t i = 0; i < tail.args.size(); ++i) {
+            env->Slot(0, i) = std::move(tail.args[i]);
+        }
+        const auto& body = lambda->body_instructions_;
+        for (size_t i = 0; i < body.size() - 1; ++i) {
+            body[i]->Execute(env);
+        }
+        auto result = body.back()->ExecuteTail(env, tail);
+        Environment::Recycle(env);
+        if (!tail.function) {
+            return result;
+        }
+        // keeps the next lambda alive while its body runs
+        running = std::move(tail.function);
+        tail.function = nullptr;
+        lambda = As<LambdaCall>(running);
     }
-    return ParseTree(body_instructions_.back(), my_scope_, false);
 }
 
 std::string LambdaCall::Serialize() {
     throw SyntaxError("LambdaCall should not be serialized");
 }
 
-std::shared_ptr<Object> LambdaCall::Eval(std::shared_ptr<Scope> scope) {
-    return std::make_shared<LambdaCall>(my_scope_, body_instructions_, args_);
-}
-
 LambdaCall& LambdaCall::operator=(LambdaCall&& other) noexcept {
-    my_scope_ = move(other.my_scope_);
+    env_ = std::move(other.env_);
     body_instructions_ = move(other.body_instructions_);
-    args_ = move(other.args_);
+    arg_count_ = other.arg_count_;
+    local_count_ = other.local_count_;
+    jit_profile_ = other.jit_profile_;
     return *this;
 }
 
 LambdaCall& LambdaCall::operator=(const LambdaCall& other) {
-    my_scope_ = other.my_scope_;
+    env_ = other.env_;
     body_instructions_ = other.body_instructions_;
-    args_ = other.args_;
+    arg_count_ = other.arg_count_;
+    local_count_ = other.local_count_;
+    jit_profile_ = other.jit_profile_;
     return *this;
 }
 
 LambdaCall::LambdaCall(LambdaCall&& other) noexcept
-    : my_scope_(move(other.my_scope_)),
+    : Function(ObjectType::kLambda),
+      GcNode(this),
+      env_(std::move(other.env_)),
       body_instructions_(move(other.body_instructions_)),
-      args_(move(other.args_)) {
+      arg_count_(other.arg_count_),
+      local_count_(other.local_count_),
+      jit_profile_(other.jit_profile_) {
 }
 
 LambdaCall::LambdaCall(const LambdaCall& other)
-    : my_scope_(other.my_scope_), body_instructions_(other.body_instructions_), args_(other.args_) {
+    : Function(ObjectType::kLambda),
+      GcNode(this),
+      env_(other.env_),
+      body_instructions_(other.body_instructions_),
+      arg_count_(other.arg_count_),
+      local_count_(other.local_count_),
+      jit_profile_(other.jit_profile_) {
 }
 
-LambdaCall::LambdaCall(std::shared_ptr<Scope> scope,
-                       const std::vector<std::shared_ptr<Object>> body,
-                       const std::vector<std::shared_ptr<Symbol>>& args)
-    : my_scope_(scope), body_instructions_(body), args_(args) {
+LambdaCall::LambdaCall(Ref<Environment> env,
+                       const std::vector<std::shared_ptr<Node>>& body, size_t arg_count,
+                       size_t local_count, std::shared_ptr<JitProfile> jit_profile)
+    : Function(ObjectType::kLambda),
+      GcNode(this),
+      env_(env),
+      body_instructions_(body),
+      arg_count_(arg_count),
+      local_count_(local_count),
+      jit_profile_(std::move(jit_profile)) {
 }
 
-std::string Lambda::Serialize() {
-    throw SyntaxError("Lambda should not be serialized");
+JitProfile* LambdaCall::GetJitProfile() const {
+    return jit_profile_.get();
+}
+
+void LambdaCall::Trace(std::vector<GcNode*>& children) {
+    if (env_) {
+        children.push_back(env_.Get());
+    }
 }
 
-std::shared_ptr<Object> Lambda::Eval(std::shared_ptr<Scope> scope) {
-    throw SyntaxError("Lambda should not be copied");
+void LambdaCall::Clear() {
+    env_ = nullptr;
 }
 
 #pragma clang diagnostic pop
\ No newline at end of file
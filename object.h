@@ -1,28 +1,216 @@
 #pragma once
 
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include "tokenizer.h"
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "gc.h"
+#include "ref.h"
+
 class Object;
+class Node;
+class JitProfile;
+
+// Type of a Scheme value. Heap objects store it in Object, the empty list, booleans and small
+// integers are immediate. Functions occupy the tail of the enum, so Is<Function> is a single
+// comparison. Builtins share one tag and can only be tested as Function.
+enum class ObjectType : uint8_t {
+    kNil,
+    kDot,
+    kNumber,
+    kBool,
+    kSymbol,
+    kCell,
+    kFolded,
+    kBuiltin,
+    // builtins the JIT compiles to machine code
+    kSum,
+    kDif,
+    kProd,
+    kNot,
+    kEqual,
+    kLess,
+    kGreater,
+    kLessEqual,
+    kGreaterEqual,
+    kLambda,
+    kCompiledLambda,
+};
+
+// Scheme value. The empty list, booleans and integers which fit in 63 bits are encoded in the
+// pointer bits, so making and copying them neither allocates nor touches a reference count. All
+// other values own a heap Object.
+class Value {
+public:
+    // empty list
+    Value() = default;
+
+    Value(std::nullptr_t) {
+    }
+
+    template <class T>
+    Value(Ref<T> object) : object_(object.Detach()) {
+    }
+
+    Value(const Value& other);
+
+    Value(Value&& other) noexcept : object_(std::exchange(other.object_, nullptr)) {
+    }
+
+    Value& operator=(const Value& other);
+
+    Value& operator=(Value&& other) noexcept;
+
+    ~Value();
+
+    static Value Integer(int64_t value);
+
+    static Value Boolean(bool value);
+
+    // content of a local variable before its 'define' is executed, never visible to Scheme code
+    static Value Unbound();
+
+    // false only for the empty list
+    explicit operator bool() const {
+        return GetBits() != kNilBits;
+    }
+
+    bool IsFalse() const {
+        return GetBits() == kFalseBits;
+    }
+
+    bool IsUnbound() const {
+        return GetBits() == kUnboundBits;
+    }
+
+    // the value is the only owner of its heap object
+    bool IsUnique() const;
+
+    // same immediate or the same heap object, what 'eq?' would compare
+    bool IsIdentical(const Value& other) const {
+        return object_ == other.object_;
+    }
+
+    // for hash containers keyed by identity, see IsIdentical
+    struct IdentityHash {
+        size_t operator()(const Value& value) const {
+            return std::hash<uintptr_t>()(value.GetBits());
+        }
+    };
+
+    struct IdentityEqual {
+        bool operator()(const Value& first, const Value& second) const {
+            return first.IsIdentical(second);
+        }
+    };
+
+    ObjectType GetType() const;
+
+    // the value must be of the matching type
+    int64_t GetInteger() const;
 
-using ObjectList = std::vector<std::shared_ptr<Object>>;
-using StringFuncMap = std::unordered_map<std::string, std::shared_ptr<Object>>;
+    bool GetBool() const;
 
-// Runtime type checking and conversion.
-template <class T>
-std::shared_ptr<T> As(const std::shared_ptr<Object>& obj) {
-    return std::dynamic_pointer_cast<T>(obj);
-}
+    // nullptr for immediate values
+    Object* GetObject() const;
 
-template <class T>
-bool Is(const std::shared_ptr<Object>& obj) {
-    return As<T>(obj).get();
+    std::string Serialize() const;
+
+private:
+    static constexpr uintptr_t kNilBits = 0;
+    // integers are shifted left by one with the low bit set, heap pointers are aligned
+    static constexpr uintptr_t kIntegerTag = 0b1;
+    static constexpr uintptr_t kSpecialMask = 0b11;
+    static constexpr uintptr_t kSpecialTag = 0b10;
+    static constexpr uintptr_t kFalseBits = 0b0010;
+    static constexpr uintptr_t kTrueBits = 0b0110;
+    static constexpr uintptr_t kUnboundBits = 0b1010;
+
+    static Value FromBits(uintptr_t bits);
+
+    uintptr_t GetBits() const {
+        return reinterpret_cast<uintptr_t>(object_);
+    }
+
+    bool IsHeap() const {
+        return GetBits() != kNilBits && (GetBits() & kSpecialMask) == 0;
+    }
+
+    Object* object_ = nullptr;
+};
+
+static_assert(sizeof(uintptr_t) == sizeof(int64_t), "immediate values need 64-bit pointers");
+
+using ObjectList = std::vector<Value>;
+// arguments which live in storage of the caller, e.g. on an evaluation stack
+using ArgSpan = std::span<const Value>;
+using StringFuncMap = std::unordered_map<std::string, Value>;
+
+// Everything except #f is true.
+inline bool IsTrue(const Value& value) {
+    return !value.IsFalse();
 }
 
+// Storage cell of a global variable. A binding keeps its address for the lifetime of its Scope,
+// so analyzed and compiled code resolves the name once and then reads the cell directly; later
+// 'define' and 'set!' of the name update the same cell.
+class Binding {
+public:
+    const Value& Get() const {
+        if (value_.IsUnbound()) {
+            throw NameError("SymbolsAreNotSelfEvaluating");
+        }
+        return value_;
+    }
+
+    void Define(Value value) {
+        value_ = std::move(value);
+        ++version_;
+    }
+
+    void Set(Value value);
+
+    bool IsDefined() const {
+        return !value_.IsUnbound();
+    }
+
+    // changes on every assignment of the variable
+    uint64_t GetVersion() const {
+        return version_;
+    }
+
+private:
+    Value value_ = Value::Unbound();
+    uint64_t version_ = 0;
+};
+
+// Expectation that a global variable still holds its current value, e.g. a builtin which
+// optimized code relies on. The value is not owned, native code which guards a call of its own
+// lambda would keep that lambda alive otherwise. Any assignment fails the guard, even one which
+// stores the same value again.
+struct BindingGuard {
+    explicit BindingGuard(Binding* binding) : binding(binding), version(binding->GetVersion()) {
+    }
+
+    bool IsValid() const {
+        return binding->GetVersion() == version;
+    }
+
+    Binding* binding;
+    uint64_t version;
+};
+
+// unordered_map never moves its elements, which keeps Binding pointers stable
+using SymbolMap = std::unordered_map<SymbolId, Binding>;
+
 class Scope {
 public:
     Scope() = default;
@@ -39,93 +227,264 @@ public:
 
     ~Scope() = default;
 
-    std::shared_ptr<Object> ResolveSymbol(const std::string& symbol);
+    // binding of the symbol in this scope or its parents, a new unbound one is added to this
+    // scope if the name is not known yet
+    Binding* GetBinding(SymbolId symbol);
+
+    Value ResolveSymbol(SymbolId symbol);
 
-    bool DefineSymbol(const std::string& symbol, std::shared_ptr<Object> ptr);
+    bool DefineSymbol(SymbolId symbol, Value ptr);
 
-    void SetSymbol(const std::string& symbol, std::shared_ptr<Object> ptr);
+    void SetSymbol(SymbolId symbol, Value ptr);
 
-    bool HasSymbol(const std::string& symbol);
+    bool HasSymbol(SymbolId symbol);
 
-    std::shared_ptr<Scope> MakeCopy();
+    // drops the values of all variables, their bindings stay valid but undefined
+    void UnbindAll();
 
 private:
+    Binding* FindBinding(SymbolId symbol);
+
     std::shared_ptr<Scope> parent_scope_ = nullptr;
-    StringFuncMap scope_;
+    SymbolMap scope_;
 };
 
-///////////////////////////////////////////////////////////////////////////////
+// Flat frame of lambda arguments and local variables addressed by (depth, slot). Call frames come
+// from a per-thread pool, a frame which is not captured by a closure when its call returns is
+// recycled together with its slot storage.
+class Environment : public RefCounted, public GcNode {
+public:
+    Environment(size_t size, Ref<Environment> parent);
+
+    GcNode* GetGcNode() override {
+        return this;
+    }
+
+    void Trace(std::vector<GcNode*>& children) override;
+
+    void Clear() override;
 
-void ConvertArgsToVector(std::shared_ptr<Object> ast, ObjectList& obj_list,
-                         std::shared_ptr<Scope> scope, bool and_or_eval_optimization);
+    static Ref<Environment> Make(size_t size, Ref<Environment> parent);
 
-std::shared_ptr<Object> ParseTree(std::shared_ptr<Object> ast, std::shared_ptr<Scope> scope,
-                                  bool and_or_eval_optimization);
+    // returns frame to the pool if env is its only owner, resets env in any case
+    static void Recycle(Ref<Environment>& env);
+
+    Value& Slot(int32_t depth, int32_t slot);
+
+private:
+    ObjectList slots_;
+    Ref<Environment> parent_;
+};
 
 ///////////////////////////////////////////////////////////////////////////////
 
-class Object : public std::enable_shared_from_this<Object> {
+class Object : public RefCounted {
 public:
-    virtual std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) = 0;
-
     virtual std::string Serialize() = 0;
 
     virtual ~Object() = default;
+
+    ObjectType GetType() const {
+        return type_;
+    }
+
+    // number of heap objects created by the current thread so far
+    static uint64_t GetAllocationCount() {
+        return allocation_count_;
+    }
+
+    // part of a syntax tree which is freed with its Arena
+    bool IsArenaAllocated() const {
+        return is_arena_allocated_;
+    }
+
+protected:
+    explicit Object(ObjectType type) : type_(type) {
+        ++allocation_count_;
+    }
+
+private:
+    friend class Arena;
+
+    inline static thread_local uint64_t allocation_count_ = 0;
+
+    const ObjectType type_;
+    bool is_arena_allocated_ = false;
 };
 
-class Dot : public Object {
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+// Heap storage of integers which do not fit in an immediate value.
+class BoxedInteger : public Object {
+public:
+    explicit BoxedInteger(int64_t value) : Object(ObjectType::kNumber), value_(value) {
+    }
 
     std::string Serialize() override;
+
+    int64_t GetValue() const {
+        return value_;
+    }
+
+private:
+    int64_t value_;
 };
 
-class Number : public Object {
-public:
-    Number(int64_t value);
+inline Value::Value(const Value& other) : object_(other.object_) {
+    if (IsHeap()) {
+        object_->AddRef();
+    }
+}
 
-    Number(const Token& token);
+// The old object is released after the assignment, its destructor may free the other value.
+inline Value& Value::operator=(const Value& other) {
+    if (this != &other) {
+        Value old(std::move(*this));
+        object_ = other.object_;
+        if (IsHeap()) {
+            object_->AddRef();
+        }
+    }
+    return *this;
+}
 
-    Number(const Number& other);
+inline Value& Value::operator=(Value&& other) noexcept {
+    if (this != &other) {
+        Value old(std::move(*this));
+        object_ = std::exchange(other.object_, nullptr);
+    }
+    return *this;
+}
 
-    Number(Number&& other) noexcept;
+inline Value::~Value() {
+    if (IsHeap()) {
+        object_->Release();
+    }
+}
 
-    Number& operator=(const Number& other);
+inline bool Value::IsUnique() const {
+    return IsHeap() && object_->GetRefCount() == 1;
+}
 
-    Number& operator=(Number&& other) noexcept;
+inline Value Value::FromBits(uintptr_t bits) {
+    Value value;
+    value.object_ = reinterpret_cast<Object*>(bits);
+    return value;
+}
 
-    ~Number() override = default;
+inline Value Value::Integer(int64_t value) {
+    constexpr int64_t kMax = std::numeric_limits<int64_t>::max() >> 1;
+    constexpr int64_t kMin = std::numeric_limits<int64_t>::min() >> 1;
+    if (value > kMax || value < kMin) {
+        return Value(MakeRef<BoxedInteger>(value));
+    }
+    return FromBits((static_cast<uintptr_t>(value) << 1) | kIntegerTag);
+}
 
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+inline Value Value::Boolean(bool value) {
+    return FromBits(value ? kTrueBits : kFalseBits);
+}
 
-    std::string Serialize() override;
+inline Value Value::Unbound() {
+    return FromBits(kUnboundBits);
+}
 
-    int64_t GetValue() const;
+inline ObjectType Value::GetType() const {
+    auto bits = GetBits();
+    if (bits & kIntegerTag) {
+        return ObjectType::kNumber;
+    }
+    if (bits == kFalseBits || bits == kTrueBits) {
+        return ObjectType::kBool;
+    }
+    if (!IsHeap()) {
+        return ObjectType::kNil;
+    }
+    return object_->GetType();
+}
 
-private:
-    int64_t value_;
-};
+inline int64_t Value::GetInteger() const {
+    if (GetBits() & kIntegerTag) {
+        return static_cast<int64_t>(GetBits()) >> 1;
+    }
+    return static_cast<BoxedInteger*>(object_)->GetValue();
+}
 
-class Bool : public Object {
+inline bool Value::GetBool() const {
+    return GetBits() == kTrueBits;
+}
+
+inline Object* Value::GetObject() const {
+    return IsHeap() ? object_ : nullptr;
+}
+
+// Runtime type checking and conversion. Every tested class provides static Classof(ObjectType).
+template <class T>
+bool Is(const Value& value) {
+    return T::Classof(value.GetType());
+}
+
+// Heap types give a borrowed pointer, valid while value is alive. Immediate types give their
+// content in std::optional. Both are empty if value is not T.
+template <class T>
+auto As(const Value& value) {
+    if constexpr (std::is_base_of_v<Object, T>) {
+        return Is<T>(value) ? static_cast<T*>(value.GetObject()) : nullptr;
+    } else {
+        return Is<T>(value) ? std::optional<T>(T(value)) : std::nullopt;
+    }
+}
+
+// Adds the object of value to children if it can be part of a reference cycle.
+inline void TraceValue(const Value& value, std::vector<GcNode*>& children) {
+    if (auto object = value.GetObject()) {
+        if (auto node = object->GetGcNode()) {
+            children.push_back(node);
+        }
+    }
+}
+
+class Dot : public Object {
 public:
-    Bool(bool inp);
+    Dot() : Object(ObjectType::kDot) {
+    }
 
-    Bool(const Token& token);
+    static bool Classof(ObjectType type) {
+        return type == ObjectType::kDot;
+    }
 
-    Bool(const Bool& other);
+private:
+    std::string Serialize() override;
+};
 
-    Bool(Bool&& other) noexcept;
+// Integer content of a value, see Value::Integer.
+class Number {
+public:
+    explicit Number(const Value& value) : value_(value.GetInteger()) {
+    }
 
-    Bool& operator=(const Bool& other);
+    static bool Classof(ObjectType type) {
+        return type == ObjectType::kNumber;
+    }
 
-    Bool& operator=(Bool&& other) noexcept;
+    int64_t GetValue() const {
+        return value_;
+    }
 
-    ~Bool() override = default;
+private:
+    int64_t value_;
+};
 
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+class Bool {
+public:
+    explicit Bool(const Value& value) : value_(value.GetBool()) {
+    }
 
-    std::string Serialize() override;
+    static bool Classof(ObjectType type) {
+        return type == ObjectType::kBool;
+    }
 
-    bool GetBool() const;
+    bool GetBool() const {
+        return value_;
+    }
 
 private:
     bool value_;
@@ -133,7 +492,7 @@ private:
 
 class Symbol : public Object {
 public:
-    Symbol(const std::string& str);
+    Symbol(std::string_view str);
 
     Symbol(const Token& token);
 
@@ -147,189 +506,244 @@ public:
 
     ~Symbol() override = default;
 
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+    static bool Classof(ObjectType type) {
+        return type == ObjectType::kSymbol;
+    }
 
     std::string Serialize() override;
 
     const std::string& GetName() const;
 
+    SymbolId GetId() const;
+
 private:
-    std::string str_;
+    const InternedSymbol* symbol_;
 };
 
 class Function : public Object {
 public:
-    virtual std::shared_ptr<Object> Apply(const ObjectList& args) = 0;
-};
+    virtual Value Apply(const ObjectList& args) = 0;
 
-class LambdaCall : public Function {
-public:
-    LambdaCall(std::shared_ptr<Scope> scope, const std::vector<std::shared_ptr<Object>> body,
-               const std::vector<std::shared_ptr<Symbol>>& args);
+    // Entry points of calls with a known number of arguments, they let callers skip building an
+    // ObjectList. By default fixed arities go to ApplySpan and ApplySpan copies into Apply, so
+    // builtins override the ones they can serve directly. The span is only valid until the
+    // function evaluates Scheme code.
+    virtual Value Apply0();
 
-    LambdaCall(const LambdaCall& other);
+    virtual Value Apply1(const Value& first);
 
-    LambdaCall(LambdaCall&& other) noexcept;
+    virtual Value Apply2(const Value& first, const Value& second);
 
-    LambdaCall& operator=(const LambdaCall& other);
+    virtual Value Apply3(const Value& first, const Value& second, const Value& third);
 
-    LambdaCall& operator=(LambdaCall&& other) noexcept;
+    virtual Value ApplySpan(ArgSpan args);
 
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+    // result depends only on the arguments and calling has no side effects
+    virtual bool IsPure() const {
+        return false;
+    }
 
-    std::string Serialize() override;
+    static bool Classof(ObjectType type) {
+        return type >= ObjectType::kBuiltin;
+    }
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    // implemented in C++, unlike lambdas
+    static bool IsBuiltin(ObjectType type) {
+        return type >= ObjectType::kBuiltin && type < ObjectType::kLambda;
+    }
 
-private:
-    std::shared_ptr<Scope> my_scope_;
-    std::vector<std::shared_ptr<Object>> body_instructions_;
-    std::vector<std::shared_ptr<Symbol>> args_;
+protected:
+    explicit Function(ObjectType type = ObjectType::kBuiltin) : Object(type) {
+    }
 };
 
-class Lambda : public Object {
+class LambdaCall : public Function, public GcNode {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+    LambdaCall(Ref<Environment> env, const std::vector<std::shared_ptr<Node>>& body,
+               size_t arg_count, size_t local_count,
+               std::shared_ptr<JitProfile> jit_profile = nullptr);
 
-    std::string Serialize() override;
-};
+    LambdaCall(const LambdaCall& other);
 
-class If : public Function {
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+    LambdaCall(LambdaCall&& other) noexcept;
 
-    std::string Serialize() override;
+    LambdaCall& operator=(const LambdaCall& other);
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
-};
+    LambdaCall& operator=(LambdaCall&& other) noexcept;
 
-class Define : public Function {
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+    static bool Classof(ObjectType type) {
+        return type == ObjectType::kLambda;
+    }
 
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
-};
+    Value Apply(const ObjectList& args) override;
 
-class Set : public Function {
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+    // nullptr unless the lambda may be compiled to native code
+    JitProfile* GetJitProfile() const;
 
-    std::string Serialize() override;
+    GcNode* GetGcNode() override {
+        return this;
+    }
+
+    void Trace(std::vector<GcNode*>& children) override;
+
+    void Clear() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+private:
+    Ref<Environment> env_;
+    std::vector<std::shared_ptr<Node>> body_instructions_;
+    size_t arg_count_;
+    // arguments first, then variables introduced by internal 'define'
+    size_t local_count_;
+    std::shared_ptr<JitProfile> jit_profile_;
 };
 
 class SetCdr : public Function {
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
+public:
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value Apply2(const Value& first, const Value& second) override;
 };
 
 class SetCar : public Function {
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
+public:
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
-};
-
-class Quote : public Function {
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
-    std::string Serialize() override;
+    Value Apply(const ObjectList& args) override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply2(const Value& first, const Value& second) override;
 };
 
 class IsNum : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value Apply1(const Value& arg) override;
 };
 
 class IsSymbol : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value Apply1(const Value& arg) override;
 };
 
 class IsBool : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value Apply1(const Value& arg) override;
 };
 
 class Abs : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value Apply1(const Value& arg) override;
+
+    bool IsPure() const override {
+        return true;
+    }
 };
 
 class Sum : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+    Sum() : Function(ObjectType::kSum) {
+    }
 
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value Apply2(const Value& first, const Value& second) override;
+
+    Value ApplySpan(ArgSpan args) override;
+
+    bool IsPure() const override {
+        return true;
+    }
 };
 
 class Dif : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+    Dif() : Function(ObjectType::kDif) {
+    }
 
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value Apply2(const Value& first, const Value& second) override;
+
+    Value ApplySpan(ArgSpan args) override;
+
+    bool IsPure() const override {
+        return true;
+    }
 };
 
 class Prod : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+    Prod() : Function(ObjectType::kProd) {
+    }
 
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value Apply2(const Value& first, const Value& second) override;
+
+    Value ApplySpan(ArgSpan args) override;
+
+    bool IsPure() const override {
+        return true;
+    }
 };
 
 class Div : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value ApplySpan(ArgSpan args) override;
 };
 
 class Min : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value ApplySpan(ArgSpan args) override;
+
+    bool IsPure() const override {
+        return true;
+    }
 };
 
 class Max : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value ApplySpan(ArgSpan args) override;
+
+    bool IsPure() const override {
+        return true;
+    }
 };
 
 class Comp : public Function {
@@ -346,11 +760,17 @@ public:
 
     ~Comp() override = default;
 
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value Apply2(const Value& first, const Value& second) override;
+
+    Value ApplySpan(ArgSpan args) override;
+
+    bool IsPure() const override {
+        return true;
+    }
 
 private:
     bool (*comp_)(int64_t, int64_t);
@@ -365,147 +785,147 @@ private:
 
 class Not : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+    Not() : Function(ObjectType::kNot) {
+    }
 
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
-};
-
-class And : public Function {
-public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+    Value Apply(const ObjectList& args) override;
 
-    std::string Serialize() override;
+    Value Apply1(const Value& arg) override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    bool IsPure() const override {
+        return true;
+    }
 };
 
-class Or : public Function {
+class Cell : public Object, public GcNode {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+    Cell(Value first = Value(), Value second = Value());
 
-    std::string Serialize() override;
+    ~Cell() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
-};
+    static bool Classof(ObjectType type) {
+        return type == ObjectType::kCell;
+    }
 
-class Cell : public Object {
-public:
-    void SetExterior(bool is_exterior);
+    GcNode* GetGcNode() override {
+        return this;
+    }
 
-    void SetFirst(const std::shared_ptr<Object>& first);
+    void Trace(std::vector<GcNode*>& children) override;
 
-    void SetSecond(const std::shared_ptr<Object>& second);
+    void Clear() override;
 
-    std::shared_ptr<Object> GetFirst() const;
+    void SetFirst(const Value& first);
 
-    std::shared_ptr<Object> GetSecond() const;
+    void SetSecond(const Value& second);
 
-    bool IsExterior();
+    const Value& GetFirst() const;
 
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+    const Value& GetSecond() const;
 
     std::string Serialize() override;
 
 private:
-    bool is_exterior_ = false;
-    std::shared_ptr<Object> first_;
-    std::shared_ptr<Object> second_;
+    Value first_;
+    Value second_;
 };
 
 class IsPair : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value Apply1(const Value& arg) override;
 };
 
 class IsNull : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value Apply1(const Value& arg) override;
 };
 
 class IsList : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
 
-private:
-    bool RecursiveCheck(std::shared_ptr<Object> ast);
+    Value Apply1(const Value& arg) override;
 };
 
 class Cons : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value Apply2(const Value& first, const Value& second) override;
 };
 
 class Car : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value Apply1(const Value& arg) override;
 };
 
 class Cdr : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+
+    Value Apply1(const Value& arg) override;
 };
 
 class List : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
 
-private:
-    void RecursiveListContraction(const ObjectList& args, size_t ind,
-                                  std::shared_ptr<Cell>& last_cell);
+    Value ApplySpan(ArgSpan args) override;
 };
 
 class ListRef : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
-
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
 
-private:
-    std::shared_ptr<Object> RecursiveListSearch(std::shared_ptr<Object> list, const size_t ind,
-                                                size_t cur_step = 0);
+    Value Apply2(const Value& first, const Value& second) override;
 };
 
 class ListTail : public Function {
 public:
-    std::shared_ptr<Object> Eval(std::shared_ptr<Scope> scope) override;
+    std::string Serialize() override;
+
+    Value Apply(const ObjectList& args) override;
 
+    Value Apply2(const Value& first, const Value& second) override;
+};
+
+// Collects the cycles of the running interpreter, gives the number of freed nodes.
+class CollectGarbage : public Function {
+public:
     std::string Serialize() override;
 
-    std::shared_ptr<Object> Apply(const ObjectList& args) override;
+    Value Apply(const ObjectList& args) override;
+};
 
-private:
-    std::shared_ptr<Object> RecursiveListSearch(std::shared_ptr<Object> list, const size_t ind,
-                                                size_t cur_step = 0);
+// Memory figures of the running interpreter as an association list:
+// ((allocated . bytes) (live . bytes) (peak . bytes) (limit . bytes)).
+class MemoryStats : public Function {
+public:
+    std::string Serialize() override;
+
+    Value Apply(const ObjectList& args) override;
 };
@@ -0,0 +1,478 @@
+#include "optimizer.h"
+
+#include <algorithm>
+
+Value Optimize(const Value& ast, std::shared_ptr<Scope> global) {
+    return Optimizer(std::move(global)).OptimizeExpression(ast);
+}
+
+FoldedCall::FoldedCall(Value value, Value call, std::vector<BindingGuard> guards)
+    : Object(ObjectType::kFolded),
+      value_(std::move(value)),
+      call_(std::move(call)),
+      guards_(std::move(guards)) {
+}
+
+std::string FoldedCall::Serialize() {
+    return call_.Serialize();
+}
+
+bool FoldedCall::IsValid() const {
+    return std::all_of(guards_.begin(), guards_.end(),
+                       [](const BindingGuard& guard) { return guard.IsValid(); });
+}
+
+const Value& FoldedCall::GetValue() const {
+    return value_;
+}
+
+const Value& FoldedCall::GetCall() const {
+    return call_;
+}
+
+const std::vector<BindingGuard>& FoldedCall::GetGuards() const {
+    return guards_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Like ListToVector, but gives nothing for an improper list instead of throwing.
+static std::optional<ObjectList> TryListToVector(Value list) {
+    ObjectList elements;
+    while (list) {
+        if (!Is<Cell>(list)) {
+            return std::nullopt;
+        }
+        elements.push_back(As<Cell>(list)->GetFirst());
+        list = As<Cell>(list)->GetSecond();
+    }
+    return elements;
+}
+
+static Value VectorToList(const ObjectList& elements) {
+    Value list;
+    for (auto it = elements.rbegin(); it != elements.rend(); ++it) {
+        list = MakeRef<Cell>(*it, std::move(list));
+    }
+    return list;
+}
+
+// Gives the original list back unless some of its elements were replaced, so that untouched
+// parts of the tree stay where the parser put them.
+static Value Rebuild(const Value& ast, const ObjectList& elements) {
+    auto rest = ast;
+    for (const auto& element : elements) {
+        if (!Is<Cell>(rest) || !As<Cell>(rest)->GetFirst().IsIdentical(element)) {
+            return VectorToList(elements);
+        }
+        rest = As<Cell>(rest)->GetSecond();
+    }
+    return rest ? VectorToList(elements) : ast;
+}
+
+static bool IsQuote(const Value& ast) {
+    if (!Is<Cell>(ast) || GetSpecialForm(As<Cell>(ast)->GetFirst()) != SpecialForm::kQuote) {
+        return false;
+    }
+    auto form = TryListToVector(ast);
+    return form && form->size() == 2;
+}
+
+// Expression which evaluates to the same value every time without side effects.
+static bool IsConstant(const Value& ast) {
+    return Is<Number>(ast) || Is<Bool>(ast) || Is<FoldedCall>(ast) || IsQuote(ast);
+}
+
+// Value of constant expression, the one computed at optimization time for FoldedCall.
+static Value GetConstantValue(const Value& ast) {
+    if (Is<FoldedCall>(ast)) {
+        return As<FoldedCall>(ast)->GetValue();
+    }
+    if (IsQuote(ast)) {
+        return As<Cell>(As<Cell>(ast)->GetSecond())->GetFirst();
+    }
+    return ast;
+}
+
+static Value MakeQuote(Value datum) {
+    thread_local const Value kQuote = MakeRef<Symbol>("quote");
+    return VectorToList({kQuote, std::move(datum)});
+}
+
+// Collects lambda parameters, gives nothing unless they are distinct symbols.
+static std::optional<LexicalScope::Frame> GetParameters(const Value& arg_list) {
+    auto args = TryListToVector(arg_list);
+    if (!args) {
+        return std::nullopt;
+    }
+    LexicalScope::Frame frame;
+    for (const auto& arg : *args) {
+        if (!Is<Symbol>(arg)) {
+            return std::nullopt;
+        }
+        auto name = As<Symbol>(arg)->GetId();
+        if (std::find(frame.begin(), frame.end(), name) != frame.end()) {
+            return std::nullopt;
+        }
+        frame.push_back(name);
+    }
+    return frame;
+}
+
+// Frame of lambda with the given parameters and body, local defines included.
+static std::optional<LexicalScope::Frame> GetLambdaFrame(const Value& arg_list,
+                                                         const ObjectList& body,
+                                                         size_t body_start_ind) {
+    auto frame = GetParameters(arg_list);
+    if (frame) {
+        for (size_t i = body_start_ind; i < body.size(); ++i) {
+            CollectDefines(body[i], *frame);
+        }
+    }
+    return frame;
+}
+
+// Tells whether the analyzer would accept the expression, checked without touching any scope.
+// Conservative, lambdas with repeated parameters are rejected for one.
+static bool IsWellFormed(const Value& ast) {
+    if (!Is<Cell>(ast)) {
+        return static_cast<bool>(ast);
+    }
+    auto form = TryListToVector(ast);
+    if (!form) {
+        return false;
+    }
+    auto all_well_formed = [&form](size_t start_ind) {
+        return std::all_of(form->begin() + start_ind, form->end(), IsWellFormed);
+    };
+
+    switch (GetSpecialForm(form->front())) {
+        case SpecialForm::kQuote:
+            return form->size() == 2;
+        case SpecialForm::kIf:
+            return (form->size() == 3 || form->size() == 4) && all_well_formed(1);
+        case SpecialForm::kDefine:
+            if (form->size() >= 3 && Is<Cell>((*form)[1])) {
+                // lambda syntax sugar: (define (name args...) body...)
+                auto signature = As<Cell>((*form)[1]);
+                return Is<Symbol>(signature->GetFirst()) &&
+                       GetParameters(signature->GetSecond()) && all_well_formed(2);
+            }
+            [[fallthrough]];
+        case SpecialForm::kSet:
+            return form->size() == 3 && Is<Symbol>((*form)[1]) && IsWellFormed((*form)[2]);
+        case SpecialForm::kLambda:
+            return form->size() >= 3 && GetParameters((*form)[1]) && all_well_formed(2);
+        case SpecialForm::kAnd:
+        case SpecialForm::kOr:
+            return all_well_formed(1);
+        case SpecialForm::kNone:
+            return all_well_formed(0);
+    }
+    return false;
+}
+
+// Tells whether expression may 'define' or 'set!' the name, nested lambdas included.
+static bool Assigns(const Value& ast, SymbolId name) {
+    if (!Is<Cell>(ast)) {
+        return false;
+    }
+    auto form = GetSpecialForm(As<Cell>(ast)->GetFirst());
+    if (form == SpecialForm::kQuote) {
+        return false;
+    }
+    auto tail = As<Cell>(ast)->GetSecond();
+    if ((form == SpecialForm::kDefine || form == SpecialForm::kSet) && Is<Cell>(tail)) {
+        auto target = As<Cell>(tail)->GetFirst();
+        if (Is<Cell>(target)) {
+            target = As<Cell>(target)->GetFirst();
+        }
+        if (Is<Symbol>(target) && As<Symbol>(target)->GetId() == name) {
+            return true;
+        }
+    }
+    for (Value it = ast; Is<Cell>(it); it = As<Cell>(it)->GetSecond()) {
+        if (Assigns(As<Cell>(it)->GetFirst(), name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Replaces references to the variable by constant expression, nothing if ast is malformed.
+static std::optional<Value> Substitute(const Value& ast, SymbolId name, const Value& constant) {
+    if (Is<Symbol>(ast)) {
+        return As<Symbol>(ast)->GetId() == name ? constant : ast;
+    }
+    if (!Is<Cell>(ast)) {
+        return ast;
+    }
+    auto form = TryListToVector(ast);
+    if (!form) {
+        return std::nullopt;
+    }
+
+    size_t start_ind = 1;
+    switch (GetSpecialForm(form->front())) {
+        case SpecialForm::kQuote:
+            return ast;
+        case SpecialForm::kLambda:
+        case SpecialForm::kDefine: {
+            if (form->size() < 2) {
+                return std::nullopt;
+            }
+            auto arg_list = (*form)[1];
+            bool is_lambda = GetSpecialForm(form->front()) == SpecialForm::kLambda;
+            if (is_lambda || Is<Cell>(arg_list)) {
+                if (!is_lambda) {
+                    // lambda syntax sugar: (define (name args...) body...)
+                    arg_list = As<Cell>(arg_list)->GetSecond();
+                }
+                auto frame = GetLambdaFrame(arg_list, *form, 2);
+                if (!frame) {
+                    return std::nullopt;
+                }
+                if (std::find(frame->begin(), frame->end(), name) != frame->end()) {
+                    return ast;
+                }
+            }
+            start_ind = 2;
+            break;
+        }
+        case SpecialForm::kSet:
+            start_ind = 2;
+            break;
+        case SpecialForm::kNone:
+            start_ind = 0;
+            break;
+        default:
+            break;
+    }
+
+    bool changed = false;
+    for (size_t i = start_ind; i < form->size(); ++i) {
+        auto element = Substitute((*form)[i], name, constant);
+        if (!element) {
+            return std::nullopt;
+        }
+        changed |= element->GetObject() != (*form)[i].GetObject();
+        (*form)[i] = std::move(*element);
+    }
+    return changed ? VectorToList(*form) : ast;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+Optimizer::Optimizer(std::shared_ptr<Scope> global) : global_(std::move(global)) {
+}
+
+Value Optimizer::OptimizeExpression(const Value& ast) {
+    if (!Is<Cell>(ast)) {
+        return ast;
+    }
+    auto form = TryListToVector(ast);
+    if (!form) {
+        return ast;
+    }
+
+    switch (GetSpecialForm(form->front())) {
+        case SpecialForm::kQuote:
+            return ast;
+        case SpecialForm::kIf:
+            return OptimizeIf(ast, *form);
+        case SpecialForm::kDefine:
+            return OptimizeDefine(ast, *form);
+        case SpecialForm::kSet:
+            return Rebuild(ast, OptimizeList(*form, 2));
+        case SpecialForm::kLambda:
+            if (form->size() < 2) {
+                return ast;
+            }
+            return OptimizeLambda(ast, (*form)[1], *form, 2);
+        case SpecialForm::kAnd:
+        case SpecialForm::kOr:
+            return Rebuild(ast, OptimizeList(*form, 1));
+        case SpecialForm::kNone:
+            return OptimizeCall(ast, *form);
+    }
+    return ast;
+}
+
+Value Optimizer::OptimizeIf(const Value& ast, const ObjectList& form) {
+    auto optimized = OptimizeList(form, 1);
+    if (optimized.size() != 3 && optimized.size() != 4) {
+        return Rebuild(ast, optimized);
+    }
+    // folded conditions are not constant, their builtins may be rebound later
+    const auto& condition = optimized[1];
+    if (!IsConstant(condition) || Is<FoldedCall>(condition)) {
+        return Rebuild(ast, optimized);
+    }
+    bool is_true = IsTrue(GetConstantValue(condition));
+    size_t discarded_ind = is_true ? 3 : 2;
+    if (discarded_ind < optimized.size() && !CanDiscard(optimized[discarded_ind])) {
+        return Rebuild(ast, optimized);
+    }
+    if (is_true) {
+        return optimized[2];
+    }
+    return optimized.size() == 4 ? optimized[3] : MakeQuote(Value());
+}
+
+bool Optimizer::CanDiscard(const Value& ast) {
+    // a variable defined in the discarded branch would stop being local
+    LexicalScope::Frame defines;
+    CollectDefines(ast, defines);
+    if (!defines.empty()) {
+        return false;
+    }
+    // syntax errors are reported even for code which is never executed
+    return IsWellFormed(ast);
+}
+
+Value Optimizer::OptimizeDefine(const Value& ast, const ObjectList& form) {
+    if (form.size() >= 2 && Is<Cell>(form[1])) {
+        // lambda syntax sugar: (define (name args...) body...)
+        return OptimizeLambda(ast, As<Cell>(form[1])->GetSecond(), form, 2);
+    }
+    return Rebuild(ast, OptimizeList(form, 2));
+}
+
+Value Optimizer::OptimizeLambda(const Value& ast, const Value& arg_list, const ObjectList& form,
+                                size_t body_start_ind) {
+    auto frame = GetLambdaFrame(arg_list, form, body_start_ind);
+    if (!frame) {
+        return ast;
+    }
+    lexical_scope_.PushFrame(std::move(*frame));
+    auto optimized = OptimizeList(form, body_start_ind);
+    lexical_scope_.PopFrame();
+    return Rebuild(ast, optimized);
+}
+
+Value Optimizer::OptimizeCall(const Value& ast, const ObjectList& form) {
+    const auto& head = form.front();
+    if (Is<Cell>(head) && GetSpecialForm(As<Cell>(head)->GetFirst()) == SpecialForm::kLambda) {
+        auto with_args = OptimizeList(form, 1);
+        auto inlined = InlineLambda(with_args);
+        if (inlined) {
+            return OptimizeExpression(inlined);
+        }
+    }
+
+    auto optimized = OptimizeList(form, 0);
+    if (auto folded = FoldCall(optimized)) {
+        return folded;
+    }
+    return Rebuild(ast, optimized);
+}
+
+ObjectList Optimizer::OptimizeList(const ObjectList& form, size_t start_ind) {
+    ObjectList optimized = form;
+    for (size_t i = start_ind; i < optimized.size(); ++i) {
+        optimized[i] = OptimizeExpression(optimized[i]);
+    }
+    return optimized;
+}
+
+Value Optimizer::FoldCall(const ObjectList& form) {
+    const auto& head = form.front();
+    if (!Is<Symbol>(head)) {
+        return nullptr;
+    }
+    auto name = As<Symbol>(head)->GetId();
+    int32_t depth;
+    int32_t slot;
+    if (lexical_scope_.Resolve(name, depth, slot)) {
+        return nullptr;
+    }
+    auto binding = global_->GetBinding(name);
+    if (!binding->IsDefined()) {
+        return nullptr;
+    }
+    auto function = binding->Get();
+    if (!Is<Function>(function) || !As<Function>(function)->IsPure()) {
+        return nullptr;
+    }
+
+    std::vector<BindingGuard> guards{BindingGuard(binding)};
+    ObjectList args;
+    for (size_t i = 1; i < form.size(); ++i) {
+        if (!IsConstant(form[i])) {
+            return nullptr;
+        }
+        if (Is<FoldedCall>(form[i])) {
+            for (const auto& guard : As<FoldedCall>(form[i])->GetGuards()) {
+                auto same_binding = [&guard](const BindingGuard& other) {
+                    return other.binding == guard.binding;
+                };
+                if (std::none_of(guards.begin(), guards.end(), same_binding)) {
+                    guards.push_back(guard);
+                }
+            }
+        }
+        args.push_back(GetConstantValue(form[i]));
+    }
+
+    Value value;
+    try {
+        value = As<Function>(function)->Apply(args);
+    } catch (const std::runtime_error&) {
+        // left to fail when executed
+        return nullptr;
+    }
+    return MakeRef<FoldedCall>(std::move(value), VectorToList(form), std::move(guards));
+}
+
+Value Optimizer::InlineLambda(const ObjectList& form) {
+    auto lambda = *TryListToVector(form.front());
+    if (lambda.size() < 3) {
+        return nullptr;
+    }
+    auto params = GetParameters(lambda[1]);
+    if (!params || params->size() + 1 != form.size()) {
+        return nullptr;
+    }
+    LexicalScope::Frame defines;
+    for (size_t i = 2; i < lambda.size(); ++i) {
+        CollectDefines(lambda[i], defines);
+    }
+
+    ObjectList body(lambda.begin() + 2, lambda.end());
+    ObjectList remaining_params;
+    ObjectList remaining_args;
+    for (size_t i = 0; i < params->size(); ++i) {
+        auto name = (*params)[i];
+        const auto& arg = form[i + 1];
+        bool substitute = IsConstant(arg) &&
+                          std::find(defines.begin(), defines.end(), name) == defines.end() &&
+                          std::none_of(body.begin(), body.end(), [name](const Value& element) {
+                              return Assigns(element, name);
+                          });
+        if (!substitute) {
+            remaining_params.push_back(As<Cell>(lambda[1])->GetFirst());
+            remaining_args.push_back(arg);
+        } else {
+            for (auto& element : body) {
+                auto substituted = Substitute(element, name, arg);
+                if (!substituted) {
+                    return nullptr;
+                }
+                element = std::move(*substituted);
+            }
+        }
+        lambda[1] = As<Cell>(lambda[1])->GetSecond();
+    }
+    if (remaining_args.size() == params->size()) {
+        return nullptr;
+    }
+
+    if (remaining_params.empty() && body.size() == 1 && defines.empty()) {
+        return body.front();
+    }
+    ObjectList new_lambda{lambda.front(), VectorToList(remaining_params)};
+    new_lambda.insert(new_lambda.end(), body.begin(), body.end());
+    ObjectList call{VectorToList(new_lambda)};
+    call.insert(call.end(), remaining_args.begin(), remaining_args.end());
+    return VectorToList(call);
+}
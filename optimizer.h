@@ -0,0 +1,75 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "analyzer.h"
+#include "object.h"
+
+// Rewrites expression read by parser before it is analyzed or compiled:
+// - calls of pure builtins with constant arguments are replaced by FoldedCall,
+// - 'if' with constant condition is replaced by the taken branch,
+// - constant arguments of immediately applied lambdas are substituted into the body.
+// Malformed forms are left as they are, so that engines report the error.
+Value Optimize(const Value& ast, std::shared_ptr<Scope> global);
+
+// Call of pure builtins with constant arguments, evaluated when the expression is optimized.
+// Builtins may be rebound by 'define' or 'set!' later, so the value is used only while every
+// global used by the call still holds the same function, otherwise the call is evaluated.
+class FoldedCall : public Object {
+public:
+    FoldedCall(Value value, Value call, std::vector<BindingGuard> guards);
+
+    static bool Classof(ObjectType type) {
+        return type == ObjectType::kFolded;
+    }
+
+    // prints the original call
+    std::string Serialize() override;
+
+    bool IsValid() const;
+
+    const Value& GetValue() const;
+
+    const Value& GetCall() const;
+
+    const std::vector<BindingGuard>& GetGuards() const;
+
+private:
+    Value value_;
+    Value call_;
+    std::vector<BindingGuard> guards_;
+};
+
+class Optimizer {
+public:
+    Optimizer(std::shared_ptr<Scope> global);
+
+    Value OptimizeExpression(const Value& ast);
+
+private:
+    Value OptimizeIf(const Value& ast, const ObjectList& form);
+
+    // tells whether pruned 'if' branch can be dropped without changing behavior
+    bool CanDiscard(const Value& ast);
+
+    Value OptimizeDefine(const Value& ast, const ObjectList& form);
+
+    Value OptimizeLambda(const Value& ast, const Value& arg_list, const ObjectList& form,
+                         size_t body_start_ind);
+
+    Value OptimizeCall(const Value& ast, const ObjectList& form);
+
+    // optimizes elements starting from start_ind, the others are kept
+    ObjectList OptimizeList(const ObjectList& form, size_t start_ind);
+
+    // nil unless the call can be folded
+    Value FoldCall(const ObjectList& form);
+
+    // substitutes constant arguments of ((lambda ...) args...), nil if there are none
+    Value InlineLambda(const ObjectList& form);
+
+    std::shared_ptr<Scope> global_;
+    LexicalScope lexical_scope_;
+};
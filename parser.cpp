@@ -1,129 +1,202 @@
 #include <parser.h>
+#include <string>
 #include <vector>
 
-std::shared_ptr<Object> Read(Tokenizer* tokenizer) {
-    if (tokenizer->IsEnd()) {
-        throw SyntaxError("Empty input");
-    }
-
-    auto result = ReadObject(tokenizer);
+#include "arena.h"
 
-    if (!tokenizer->IsEnd()) {
-        throw SyntaxError("Incorrect input");
+template <class T, class... Args>
+static Ref<T> MakeNode(Arena* arena, Args&&... args) {
+    if (arena) {
+        return arena->Make<T>(std::forward<Args>(args)...);
     }
+    return MakeRef<T>(std::forward<Args>(args)...);
+}
 
-    return result;
+// Symbols carry nothing but their interned entry, one object per name serves the whole thread.
+static Value MakeSymbol(const Token& token) {
+    thread_local std::vector<Value> symbols;
+    auto id = std::get<SymbolToken>(token).symbol->id;
+    if (id >= symbols.size()) {
+        symbols.resize(id + 1);
+    }
+    if (!symbols[id]) {
+        symbols[id] = MakeRef<Symbol>(token);
+    }
+    return symbols[id];
 }
 
-std::shared_ptr<Object> ReadObject(Tokenizer* tokenizer) {
-    Token cur_token = tokenizer->GetToken();
-    tokenizer->Next();
+// List or quotation whose elements are being read, the reader keeps them on an explicit stack.
+struct PendingForm {
+    PendingForm(bool quote, Arena* form_arena, Arena* form_element_arena)
+        : is_quote(quote), arena(form_arena), element_arena(form_element_arena) {
+    }
 
-    switch (cur_token.index()) {
-        case 0:  // ConstantToken
-        {
-            return std::make_shared<Number>(Number(cur_token));
-        }
-        case 1:  // BracketToken
-        {
-            auto bracket = std::get<BracketToken>(cur_token);
-            if (bracket == BracketToken::CLOSE) {
-                throw SyntaxError("Wrong brackets order");
-            }
-            return ReadList(tokenizer);
-        }
-        case 2:  // SymbolToken
-        {
-            return std::make_shared<Symbol>(Symbol(cur_token));
+    // 'x is read as (quote x), the form ends with its only element
+    bool is_quote;
+    // pairs of the form itself
+    Arena* arena;
+    // elements, the code keeps quoted data so it goes to the heap right away
+    Arena* element_arena;
+    Value head;
+    Cell* tail = nullptr;
+    bool after_dot = false;
+    bool has_last = false;
+};
+
+static void Append(PendingForm* list, Value element) {
+    static const auto kQuoteId = InternSymbol("quote")->id;
+    // pair or improper list
+    if (list->has_last) {
+        throw SyntaxError("Incorrect Pair Syntax");
+    }
+    if (Is<Dot>(element)) {
+        if (!list->tail || list->after_dot) {
+            throw SyntaxError("Incorrect Pair Syntax");
         }
-        case 3:  // QuoteToken
-        {
-            auto cell = std::make_shared<Cell>();
-            cell->SetFirst(std::make_shared<Symbol>(Symbol(SymbolToken{.name = "quote"})));
-
-            if (tokenizer->IsEnd()) {
-                throw SyntaxError("Incorrect quote syntax");
-            }
+        list->after_dot = true;
+        return;
+    }
+    if (list->after_dot) {
+        list->tail->SetSecond(element);
+        list->has_last = true;
+        return;
+    }
 
-            cell->SetSecond(ReadObject(tokenizer));
-            return cell;
-        }
-        case 4:  // DotToken
-        {
-            return std::make_shared<Dot>();
-        }
-        case 5:  // Boolean
-        {
-            return std::make_shared<Bool>(Bool(cur_token));
-        }
-        case std::variant_npos: {
-            throw SyntaxError("Token missing");
+    auto cell = MakeNode<Cell>(list->arena, std::move(element));
+    auto tail = cell.Get();
+    if (list->tail) {
+        list->tail->SetSecond(std::move(cell));
+    } else {
+        // data of (quote ...) goes to the heap, like that of 'x
+        if (Is<Symbol>(tail->GetFirst()) && As<Symbol>(tail->GetFirst())->GetId() == kQuoteId) {
+            list->element_arena = nullptr;
         }
+        list->head = std::move(cell);
     }
-    throw SyntaxError("Unknown Token");
+    list->tail = tail;
 }
 
-std::shared_ptr<Object> ParseObjectList(const ObjectList& list, size_t start_ind = 0) {
-    auto cell = std::make_shared<Cell>();
-    if (!start_ind) {
-        cell->SetExterior(true);
-    }
-
-    if (Is<Dot>(list[start_ind])) {
+static Value Finish(PendingForm* list) {
+    if (list->after_dot && !list->has_last) {
         throw SyntaxError("Incorrect Pair Syntax");
     }
+    return std::move(list->head);
+}
 
-    cell->SetFirst(list[start_ind++]);
+static bool IsClosingBracket(const Token& token) {
+    return token.index() == 1 && std::get<BracketToken>(token) == BracketToken::CLOSE;
+}
 
-    if (start_ind == list.size()) {
-        cell->SetSecond(nullptr);
-        return cell;
+// Reads a datum without recursion, so neither long nor deeply nested lists overflow the C++
+// stack. Each pair is appended to the tail of its list as soon as its element is read.
+static Value ReadForms(Tokenizer* tokenizer, Arena* arena, size_t max_depth, bool in_list) {
+    std::vector<PendingForm> stack;
+    auto open = [&](bool is_quote, Arena* form_arena, Arena* element_arena) {
+        if (stack.size() >= max_depth) {
+            throw SyntaxError("Nesting is deeper than " + std::to_string(max_depth) + " levels");
+        }
+        stack.emplace_back(is_quote, form_arena, element_arena);
+    };
+    if (in_list) {
+        open(false, arena, arena);
     }
 
-    // pair or improper list
-    if (Is<Dot>(list[start_ind])) {
-        if (++start_ind == list.size() || start_ind != list.size() - 1) {
-            throw SyntaxError("Incorrect Pair Syntax");
+    while (true) {
+        if (stack.empty() && tokenizer->IsEnd()) {
+            throw SyntaxError("Empty input");
+        }
+        if (!stack.empty() && tokenizer->IsEnd()) {
+            throw SyntaxError("Incorrect list");
         }
 
-        // not empty pair
-        if (Is<Cell>(list[start_ind]) && !As<Cell>(list[start_ind])->GetFirst().get() &&
-            !As<Cell>(list[start_ind])->GetSecond().get()) {
-            cell->SetSecond(nullptr);
-            return cell;
+        Value value;
+        const auto& token = tokenizer->GetToken();
+        auto current_arena = stack.empty() ? arena : stack.back().element_arena;
+        if (!stack.empty() && !stack.back().is_quote && IsClosingBracket(token)) {
+            tokenizer->Next();
+            value = Finish(&stack.back());
+            stack.pop_back();
+        } else {
+            switch (token.index()) {
+                case 0:  // ConstantToken
+                {
+                    value = Value::Integer(std::get<ConstantToken>(token).value);
+                    break;
+                }
+                case 1:  // BracketToken
+                {
+                    if (std::get<BracketToken>(token) == BracketToken::CLOSE) {
+                        throw SyntaxError("Wrong brackets order");
+                    }
+                    tokenizer->Next();
+                    open(false, current_arena, current_arena);
+                    continue;
+                }
+                case 2:  // SymbolToken
+                {
+                    value = MakeSymbol(token);
+                    break;
+                }
+                case 3:  // QuoteToken
+                {
+                    tokenizer->Next();
+                    if (tokenizer->IsEnd()) {
+                        throw SyntaxError("Incorrect quote syntax");
+                    }
+                    open(true, current_arena, nullptr);
+                    continue;
+                }
+                case 4:  // DotToken
+                {
+                    // dots only mark improper lists and carry no state, one object serves the
+                    // whole thread like symbols do
+                    thread_local const Value kDot = MakeRef<Dot>();
+                    value = kDot;
+                    break;
+                }
+                case 5:  // Boolean
+                {
+                    value = Value::Boolean(std::get<Boolean>(token) == Boolean::TRUE);
+                    break;
+                }
+                default: {
+                    throw SyntaxError("Unknown Token");
+                }
+            }
+            tokenizer->Next();
         }
 
-        // short form for lists
-        cell->SetSecond(list[start_ind]);
-        if (Is<Cell>(cell->GetSecond()) && !Is<Cell>(cell->GetFirst())) {
-            As<Cell>(cell->GetSecond())->SetExterior(false);
+        thread_local const Value kQuote = MakeRef<Symbol>("quote");
+        while (!stack.empty() && stack.back().is_quote) {
+            auto quote_arena = stack.back().arena;
+            value = MakeNode<Cell>(quote_arena, kQuote, MakeNode<Cell>(quote_arena, value));
+            stack.pop_back();
         }
-        return cell;
+        if (stack.empty()) {
+            return value;
+        }
+        Append(&stack.back(), std::move(value));
     }
-
-    cell->SetSecond(ParseObjectList(list, start_ind));
-    return cell;
 }
 
-std::shared_ptr<Object> ReadList(Tokenizer* tokenizer) {
-    ObjectList list;
-    bool was_closing_bracket = false;
-    while (!tokenizer->IsEnd()) {
-        if (tokenizer->GetToken().index() == 1 &&
-            std::get<BracketToken>(tokenizer->GetToken()) == BracketToken::CLOSE) {
-            was_closing_bracket = true;
-            tokenizer->Next();
-            break;
-        }
-        list.push_back(ReadObject(tokenizer));
+Value Read(Tokenizer* tokenizer, Arena* arena, size_t max_depth) {
+    if (tokenizer->IsEnd()) {
+        throw SyntaxError("Empty input");
     }
 
-    if (!was_closing_bracket) {
-        throw SyntaxError("Incorrect list");
-    }
+    auto result = ReadObject(tokenizer, arena, max_depth);
 
-    if (list.empty()) {
-        return nullptr;
+    if (!tokenizer->IsEnd()) {
+        throw SyntaxError("Incorrect input");
     }
-    return ParseObjectList(list);
+
+    return result;
+}
+
+Value ReadObject(Tokenizer* tokenizer, Arena* arena, size_t max_depth) {
+    return ReadForms(tokenizer, arena, max_depth, false);
+}
+
+Value ReadList(Tokenizer* tokenizer, Arena* arena, size_t max_depth) {
+    return ReadForms(tokenizer, arena, max_depth, true);
 }
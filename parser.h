@@ -1,14 +1,21 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
 
 #include "object.h"
 #include "tokenizer.h"
 
-std::shared_ptr<Object> Read(Tokenizer* tokenizer);
+class Arena;
 
-std::shared_ptr<Object> ReadObject(Tokenizer* tokenizer);
+// Lists and quotations nested deeper than this are rejected with SyntaxError, code which walks
+// the tree recursively would overflow the stack otherwise.
+constexpr size_t kMaxReadDepth = 1000;
 
-std::shared_ptr<Object> ReadList(Tokenizer* tokenizer);
+// Without an arena the tree is allocated on the heap.
+Value Read(Tokenizer* tokenizer, Arena* arena = nullptr, size_t max_depth = kMaxReadDepth);
 
-std::shared_ptr<Object> ParseObjectList(const ObjectList& list, size_t start_ind);
+Value ReadObject(Tokenizer* tokenizer, Arena* arena = nullptr, size_t max_depth = kMaxReadDepth);
+
+// reads the rest of a list whose opening bracket is consumed
+Value ReadList(Tokenizer* tokenizer, Arena* arena = nullptr, size_t max_depth = kMaxReadDepth);
@@ -0,0 +1,288 @@
+#include "pool.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#else
+#define ASAN_POISON_MEMORY_REGION(address, size) ((void)(address), (void)(size))
+#define ASAN_UNPOISON_MEMORY_REGION(address, size) ((void)(address), (void)(size))
+#endif
+
+static constexpr size_t kClassCount = ObjectPool::kMaxBlockSize / ObjectPool::kGranularity;
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+// Slabs of a size class are chained through their first bytes, so they stay reachable.
+struct SizeClass {
+    FreeBlock* free_list;
+    char* slab_begin;
+    char* slab_end;
+    void* slabs;
+    // allocations minus frees of this thread, blocks may be freed by another one, so only the
+    // sum over all threads is meaningful. Written by the thread alone, read by GetStats.
+    std::atomic<int64_t> live;
+    size_t capacity;
+    uint64_t allocations;
+    uint64_t hits;
+};
+
+// trivially destructible, objects freed while the thread exits still find it
+struct ThreadClasses {
+    std::array<SizeClass, kClassCount> classes;
+    // set once the slabs are handed over, the thread then uses the shared classes
+    bool exited;
+};
+
+// Registers the classes of the thread for GetStats, hands them over to the shared ones on exit.
+struct ThreadExit {
+    explicit ThreadExit(ThreadClasses* classes);
+
+    ~ThreadExit();
+
+    ThreadClasses* thread_classes;
+};
+
+static ThreadClasses* GetThreadClasses() {
+    thread_local ThreadClasses thread_classes{};
+    // any thread with blocks on its free lists got here first
+    thread_local ThreadExit thread_exit(&thread_classes);
+    return &thread_classes;
+}
+
+// Blocks of exited threads, taken by threads whose own classes run out. Their objects may still
+// be alive in other threads, so the slabs are kept rather than freed.
+struct SharedClass {
+    FreeBlock* free_list;
+    size_t free_count;
+    void* slabs;
+    // what exited threads counted, and their allocations and frees since
+    int64_t live;
+};
+
+struct SharedClasses {
+    std::mutex mutex;
+    std::array<SharedClass, kClassCount> classes{};
+    std::vector<ThreadClasses*> threads;
+};
+
+static SharedClasses* GetSharedClasses() {
+    // never destroyed, threads may still exit while statics are destroyed
+    static auto shared = new SharedClasses();
+    return shared;
+}
+
+static void AddLive(SizeClass* size_class, int64_t delta) {
+    auto live = size_class->live.load(std::memory_order_relaxed);
+    size_class->live.store(live + delta, std::memory_order_relaxed);
+}
+
+static size_t GetClassIndex(size_t size) {
+    return (size - 1) / ObjectPool::kGranularity;
+}
+
+static size_t GetBlockSize(size_t size) {
+    return (size + ObjectPool::kGranularity - 1) / ObjectPool::kGranularity *
+           ObjectPool::kGranularity;
+}
+
+static void PushBlock(FreeBlock** free_list, void* block, size_t block_size) {
+    auto free_block = static_cast<FreeBlock*>(block);
+    free_block->next = *free_list;
+    *free_list = free_block;
+    // catches use after free in sanitizer builds like the global allocator does
+    ASAN_POISON_MEMORY_REGION(block, block_size);
+}
+
+static void* PopBlock(FreeBlock** free_list, size_t block_size) {
+    auto block = *free_list;
+    ASAN_UNPOISON_MEMORY_REGION(block, block_size);
+    *free_list = block->next;
+    return block;
+}
+
+// Puts the blocks in front of the list, gives their number.
+static size_t SpliceBlocks(FreeBlock** free_list, FreeBlock* blocks) {
+    if (!blocks) {
+        return 0;
+    }
+    size_t count = 1;
+    auto last = blocks;
+    while (true) {
+        ASAN_UNPOISON_MEMORY_REGION(last, sizeof(FreeBlock));
+        if (!last->next) {
+            break;
+        }
+        auto next = last->next;
+        ASAN_POISON_MEMORY_REGION(last, sizeof(FreeBlock));
+        last = next;
+        ++count;
+    }
+    last->next = *free_list;
+    ASAN_POISON_MEMORY_REGION(last, sizeof(FreeBlock));
+    *free_list = blocks;
+    return count;
+}
+
+static void SpliceSlabs(void** slabs, void* other) {
+    if (!other) {
+        return;
+    }
+    auto last = other;
+    while (auto next = *static_cast<void**>(last)) {
+        last = next;
+    }
+    *static_cast<void**>(last) = *slabs;
+    *slabs = other;
+}
+
+static char* AllocateSlab(void** slabs) {
+    auto slab = static_cast<char*>(::operator new(ObjectPool::kSlabSize));
+    *reinterpret_cast<void**>(slab) = *slabs;
+    *slabs = slab;
+    return slab;
+}
+
+static void* Carve(SizeClass* size_class, size_t block_size) {
+    if (size_class->slab_begin + block_size > size_class->slab_end) {
+        auto slab = AllocateSlab(&size_class->slabs);
+        size_class->slab_begin = slab + ObjectPool::kGranularity;
+        size_class->slab_end = slab + ObjectPool::kSlabSize;
+    }
+    auto block = size_class->slab_begin;
+    size_class->slab_begin += block_size;
+    ++size_class->capacity;
+    return block;
+}
+
+ThreadExit::ThreadExit(ThreadClasses* classes) : thread_classes(classes) {
+    auto shared = GetSharedClasses();
+    std::lock_guard lock(shared->mutex);
+    shared->threads.push_back(classes);
+}
+
+// the rest of each current slab goes as free blocks
+ThreadExit::~ThreadExit() {
+    auto shared = GetSharedClasses();
+    std::lock_guard lock(shared->mutex);
+    std::erase(shared->threads, thread_classes);
+    for (size_t i = 0; i < kClassCount; ++i) {
+        auto& size_class = thread_classes->classes[i];
+        auto& shared_class = shared->classes[i];
+        auto block_size = (i + 1) * ObjectPool::kGranularity;
+        for (; size_class.slab_begin + block_size <= size_class.slab_end;
+             size_class.slab_begin += block_size) {
+            PushBlock(&shared_class.free_list, size_class.slab_begin, block_size);
+            ++shared_class.free_count;
+        }
+        shared_class.free_count += SpliceBlocks(&shared_class.free_list, size_class.free_list);
+        SpliceSlabs(&shared_class.slabs, size_class.slabs);
+        shared_class.live += size_class.live.exchange(0, std::memory_order_relaxed);
+        size_class.free_list = nullptr;
+        size_class.slab_begin = nullptr;
+        size_class.slab_end = nullptr;
+        size_class.slabs = nullptr;
+    }
+    thread_classes->exited = true;
+}
+
+// Takes the blocks exited threads left, if there are any.
+static void Adopt(SizeClass* size_class, size_t index) {
+    auto shared = GetSharedClasses();
+    std::lock_guard lock(shared->mutex);
+    auto& shared_class = shared->classes[index];
+    size_class->free_list = std::exchange(shared_class.free_list, nullptr);
+    size_class->capacity += std::exchange(shared_class.free_count, 0);
+}
+
+// Blocks wanted while the thread exits come from the shared classes.
+static void* AllocateShared(size_t index, size_t block_size) {
+    auto shared = GetSharedClasses();
+    std::lock_guard lock(shared->mutex);
+    auto& shared_class = shared->classes[index];
+    if (!shared_class.free_list) {
+        auto slab = AllocateSlab(&shared_class.slabs);
+        for (auto block = slab + ObjectPool::kGranularity;
+             block + block_size <= slab + ObjectPool::kSlabSize; block += block_size) {
+            PushBlock(&shared_class.free_list, block, block_size);
+            ++shared_class.free_count;
+        }
+    }
+    --shared_class.free_count;
+    ++shared_class.live;
+    return PopBlock(&shared_class.free_list, block_size);
+}
+
+void* ObjectPool::Allocate(size_t size) {
+    if (size > kMaxBlockSize) {
+        return ::operator new(size);
+    }
+    auto thread_classes = GetThreadClasses();
+    auto index = GetClassIndex(size);
+    auto block_size = GetBlockSize(size);
+    if (thread_classes->exited) {
+        return AllocateShared(index, block_size);
+    }
+    auto size_class = &thread_classes->classes[index];
+    ++size_class->allocations;
+    AddLive(size_class, 1);
+    if (!size_class->free_list && size_class->slab_begin + block_size > size_class->slab_end) {
+        Adopt(size_class, index);
+    }
+    if (size_class->free_list) {
+        ++size_class->hits;
+        return PopBlock(&size_class->free_list, block_size);
+    }
+    return Carve(size_class, block_size);
+}
+
+void ObjectPool::Free(void* block, size_t size) {
+    if (size > kMaxBlockSize) {
+        ::operator delete(block);
+        return;
+    }
+    auto thread_classes = GetThreadClasses();
+    auto index = GetClassIndex(size);
+    if (thread_classes->exited) {
+        auto shared = GetSharedClasses();
+        std::lock_guard lock(shared->mutex);
+        auto& shared_class = shared->classes[index];
+        PushBlock(&shared_class.free_list, block, GetBlockSize(size));
+        ++shared_class.free_count;
+        --shared_class.live;
+        return;
+    }
+    auto size_class = &thread_classes->classes[index];
+    AddLive(size_class, -1);
+    PushBlock(&size_class->free_list, block, GetBlockSize(size));
+}
+
+std::vector<PoolStats> ObjectPool::GetStats() {
+    auto thread_classes = GetThreadClasses();
+    auto shared = GetSharedClasses();
+    std::lock_guard lock(shared->mutex);
+    std::vector<PoolStats> stats;
+    for (size_t block_size = kGranularity; block_size <= kMaxBlockSize;
+         block_size += kGranularity) {
+        auto index = GetClassIndex(block_size);
+        auto live = shared->classes[index].live;
+        for (auto other : shared->threads) {
+            live += other->classes[index].live.load(std::memory_order_relaxed);
+        }
+        auto size_class = &thread_classes->classes[index];
+        // threads running meanwhile may be seen freeing a block before allocating it
+        stats.push_back(PoolStats{.block_size = block_size,
+                                  .live = static_cast<size_t>(std::max<int64_t>(live, 0)),
+                                  .capacity = size_class->capacity,
+                                  .allocations = size_class->allocations,
+                                  .hits = size_class->hits});
+    }
+    return stats;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct PoolStats {
+    size_t block_size = 0;
+    // blocks handed out and not freed yet by any thread, the other counts are per thread
+    size_t live = 0;
+    // blocks carved from slabs so far, live or on the free list
+    size_t capacity = 0;
+    uint64_t allocations = 0;
+    // allocations served from the free list
+    uint64_t hits = 0;
+};
+
+// Allocator of the small objects the interpreter creates by the million: pairs, boxed integers,
+// closures and call frames. Every size class carves blocks from slabs and keeps freed ones on a
+// per-thread free list. Slabs are never returned, objects may outlive the interpreter and the
+// thread which created them. An exiting thread hands its blocks over to a shared list which
+// other threads take from once theirs run out. Larger objects go to the global operator new.
+class ObjectPool {
+public:
+    static void* Allocate(size_t size);
+
+    static void Free(void* block, size_t size);
+
+    // size classes of the current thread, smallest first
+    static std::vector<PoolStats> GetStats();
+
+    static constexpr size_t kGranularity = 16;
+    static constexpr size_t kMaxBlockSize = 128;
+    static constexpr size_t kSlabSize = 64 * 1024;
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#ifdef SCHEME_ATOMIC_REFCOUNT
+#include <atomic>
+#endif
+
+#include "pool.h"
+
+class GcNode;
+
+// Reference count embedded in a heap object, it saves the separate control block of shared_ptr.
+// An interpreter and everything it creates are confined to one thread, so the count uses plain
+// increments. Builds which share objects between threads define SCHEME_ATOMIC_REFCOUNT.
+class RefCounted {
+public:
+    RefCounted() : is_charged_(std::exchange(pending_charge_, false)) {
+    }
+
+    // a copy is a new object, it has no owners yet
+    RefCounted(const RefCounted&) : RefCounted() {
+    }
+
+    RefCounted& operator=(const RefCounted&) {
+        return *this;
+    }
+
+    // the size is charged to the heap active on this thread, see Heap::SetLimit
+    static void* operator new(size_t size);
+
+    // credits the heap active on this thread if the object was charged to one
+    static void operator delete(void* block, size_t size);
+
+    void AddRef() const {
+        ++ref_count_;
+    }
+
+    // deletes the object when its last owner goes away
+    void Release() const {
+        if (--ref_count_ == 0) {
+            delete this;
+        }
+    }
+
+    // number of owners, 0 if the object is not managed by Ref, e.g. a local variable
+    size_t GetRefCount() const {
+        return ref_count_;
+    }
+
+    // Hooks of the cycle collector. Objects which can be part of a reference cycle embed a
+    // GcNode and override all three.
+    virtual GcNode* GetGcNode() {
+        return nullptr;
+    }
+
+    // adds the nodes this object holds strong references to
+    virtual void Trace(std::vector<GcNode*>&) {
+    }
+
+    // drops the references reported by Trace, called for unreachable objects only
+    virtual void Clear() {
+    }
+
+protected:
+    // runs last before operator delete, the objects this one held are released by then
+    virtual ~RefCounted() {
+        freed_charge_ = is_charged_;
+    }
+
+private:
+    // set by operator new for the constructor which runs right after it
+    inline static thread_local bool pending_charge_ = false;
+    // set by the destructor for operator delete
+    inline static thread_local bool freed_charge_ = false;
+
+#ifdef SCHEME_ATOMIC_REFCOUNT
+    mutable std::atomic<uint32_t> ref_count_ = 0;
+#else
+    mutable uint32_t ref_count_ = 0;
+#endif
+
+protected:
+    // the size of the object counts towards the live bytes of a heap, objects created while
+    // none is active don't. After the count, so that it takes padding.
+    bool is_charged_;
+};
+
+// Owning pointer to a RefCounted object.
+template <class T>
+class Ref {
+public:
+    Ref() = default;
+
+    Ref(std::nullptr_t) {
+    }
+
+    explicit Ref(T* object) : object_(object) {
+        if (object_) {
+            object_->AddRef();
+        }
+    }
+
+    Ref(const Ref& other) : Ref(other.object_) {
+    }
+
+    template <class U>
+    Ref(const Ref<U>& other) : Ref(other.Get()) {
+    }
+
+    Ref(Ref&& other) noexcept : object_(std::exchange(other.object_, nullptr)) {
+    }
+
+    template <class U>
+    Ref(Ref<U>&& other) noexcept : object_(other.Detach()) {
+    }
+
+    Ref& operator=(Ref other) noexcept {
+        std::swap(object_, other.object_);
+        return *this;
+    }
+
+    ~Ref() {
+        if (object_) {
+            object_->Release();
+        }
+    }
+
+    T* Get() const {
+        return object_;
+    }
+
+    T* operator->() const {
+        return object_;
+    }
+
+    T& operator*() const {
+        return *object_;
+    }
+
+    explicit operator bool() const {
+        return object_ != nullptr;
+    }
+
+    // gives up ownership without releasing the object
+    T* Detach() {
+        return std::exchange(object_, nullptr);
+    }
+
+private:
+    T* object_ = nullptr;
+};
+
+template <class T, class... Args>
+Ref<T> MakeRef(Args&&... args) {
+    return Ref<T>(new T(std::forward<Args>(args)...));
+}
@@ -0,0 +1,176 @@
+#include "scanner.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define SCHEME_SCAN_X86_64
+#endif
+
+enum class CharClass { kSpace, kSymbol, kDigit };
+
+template <CharClass kClass>
+static bool IsOfClass(unsigned char c) {
+    if constexpr (kClass == CharClass::kSpace) {
+        return std::isspace(c);
+    } else if constexpr (kClass == CharClass::kSymbol) {
+        return IsStrContains(c);
+    } else {
+        return std::isdigit(c);
+    }
+}
+
+template <CharClass kClass>
+static const char* SkipScalar(const char* pos, const char* end) {
+    while (pos != end && IsOfClass<kClass>(static_cast<unsigned char>(*pos))) {
+        ++pos;
+    }
+    return pos;
+}
+
+#ifdef SCHEME_SCAN_X86_64
+
+// Bytes are compared as signed, so a range check first moves lo to -128. Bytes above 127 wrap
+// to the top and never match, like std::isalpha and friends in the "C" locale.
+static __m128i InRange(__m128i bytes, char lo, char hi) {
+    auto shifted = _mm_add_epi8(bytes, _mm_set1_epi8(static_cast<char>(-128 - lo)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(hi - lo - 127)));
+}
+
+static __m128i Equal(__m128i bytes, char c) {
+    return _mm_cmpeq_epi8(bytes, _mm_set1_epi8(c));
+}
+
+template <CharClass kClass>
+static __m128i ClassMask(__m128i bytes) {
+    if constexpr (kClass == CharClass::kSpace) {
+        return _mm_or_si128(Equal(bytes, ' '), InRange(bytes, '\t', '\r'));
+    } else if constexpr (kClass == CharClass::kSymbol) {
+        auto letters = InRange(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), 'a', 'z');
+        auto ranges = _mm_or_si128(_mm_or_si128(letters, InRange(bytes, '0', '9')),
+                                   InRange(bytes, '<', '>'));
+        auto marks = _mm_or_si128(_mm_or_si128(Equal(bytes, '*'), Equal(bytes, '/')),
+                                  _mm_or_si128(Equal(bytes, '#'), Equal(bytes, '?')));
+        auto dashes = _mm_or_si128(Equal(bytes, '!'), Equal(bytes, '-'));
+        return _mm_or_si128(_mm_or_si128(ranges, marks), dashes);
+    } else {
+        return InRange(bytes, '0', '9');
+    }
+}
+
+template <CharClass kClass>
+static const char* SkipSse2(const char* pos, const char* end) {
+    while (end - pos >= 16) {
+        auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        auto outside = ~_mm_movemask_epi8(ClassMask<kClass>(bytes)) & 0xffff;
+        if (outside) {
+            return pos + __builtin_ctz(outside);
+        }
+        pos += 16;
+    }
+    return SkipScalar<kClass>(pos, end);
+}
+
+__attribute__((target("avx2"))) static __m256i InRange(__m256i bytes, char lo, char hi) {
+    auto shifted = _mm256_add_epi8(bytes, _mm256_set1_epi8(static_cast<char>(-128 - lo)));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(hi - lo - 127)), shifted);
+}
+
+__attribute__((target("avx2"))) static __m256i Equal(__m256i bytes, char c) {
+    return _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(c));
+}
+
+template <CharClass kClass>
+__attribute__((target("avx2"))) static __m256i ClassMask(__m256i bytes) {
+    if constexpr (kClass == CharClass::kSpace) {
+        return _mm256_or_si256(Equal(bytes, ' '), InRange(bytes, '\t', '\r'));
+    } else if constexpr (kClass == CharClass::kSymbol) {
+        auto letters = InRange(_mm256_or_si256(bytes, _mm256_set1_epi8(0x20)), 'a', 'z');
+        auto ranges = _mm256_or_si256(_mm256_or_si256(letters, InRange(bytes, '0', '9')),
+                                      InRange(bytes, '<', '>'));
+        auto marks = _mm256_or_si256(_mm256_or_si256(Equal(bytes, '*'), Equal(bytes, '/')),
+                                     _mm256_or_si256(Equal(bytes, '#'), Equal(bytes, '?')));
+        auto dashes = _mm256_or_si256(Equal(bytes, '!'), Equal(bytes, '-'));
+        return _mm256_or_si256(_mm256_or_si256(ranges, marks), dashes);
+    } else {
+        return InRange(bytes, '0', '9');
+    }
+}
+
+template <CharClass kClass>
+__attribute__((target("avx2"))) static const char* SkipAvx2(const char* pos, const char* end) {
+    while (end - pos >= 32) {
+        auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+        auto outside = ~static_cast<uint32_t>(_mm256_movemask_epi8(ClassMask<kClass>(bytes)));
+        if (outside) {
+            return pos + __builtin_ctz(outside);
+        }
+        pos += 32;
+    }
+    // the tail is shorter than a vector
+    return SkipSse2<kClass>(pos, end);
+}
+
+#endif
+
+struct Scanner {
+    const char* (*skip_space)(const char*, const char*);
+    const char* (*skip_symbol_chars)(const char*, const char*);
+    const char* (*skip_digits)(const char*, const char*);
+};
+
+static Scanner MakeScanner(ScanLevel level) {
+#ifdef SCHEME_SCAN_X86_64
+    if (level == ScanLevel::kAvx2) {
+        return {SkipAvx2<CharClass::kSpace>, SkipAvx2<CharClass::kSymbol>,
+                SkipAvx2<CharClass::kDigit>};
+    }
+    if (level == ScanLevel::kSse2) {
+        return {SkipSse2<CharClass::kSpace>, SkipSse2<CharClass::kSymbol>,
+                SkipSse2<CharClass::kDigit>};
+    }
+#endif
+    return {SkipScalar<CharClass::kSpace>, SkipScalar<CharClass::kSymbol>,
+            SkipScalar<CharClass::kDigit>};
+}
+
+static ScanLevel& CurrentLevel() {
+    static ScanLevel level = GetMaxScanLevel();
+    return level;
+}
+
+static Scanner& CurrentScanner() {
+    static Scanner scanner = MakeScanner(CurrentLevel());
+    return scanner;
+}
+
+const char* SkipSpace(const char* pos, const char* end) {
+    return CurrentScanner().skip_space(pos, end);
+}
+
+const char* SkipSymbolChars(const char* pos, const char* end) {
+    return CurrentScanner().skip_symbol_chars(pos, end);
+}
+
+const char* SkipDigits(const char* pos, const char* end) {
+    return CurrentScanner().skip_digits(pos, end);
+}
+
+ScanLevel GetMaxScanLevel() {
+#ifdef SCHEME_SCAN_X86_64
+    // SSE2 is part of x86-64
+    return __builtin_cpu_supports("avx2") ? ScanLevel::kAvx2 : ScanLevel::kSse2;
+#else
+    return ScanLevel::kScalar;
+#endif
+}
+
+ScanLevel GetScanLevel() {
+    return CurrentLevel();
+}
+
+void SetScanLevel(ScanLevel level) {
+    CurrentLevel() = std::min(level, GetMaxScanLevel());
+    CurrentScanner() = MakeScanner(CurrentLevel());
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cctype>
+
+// Instruction sets the character scanner can use.
+enum class ScanLevel { kScalar, kSse2, kAvx2 };
+
+inline bool IsStrBeg(int c) {
+    return std::isalpha(c) || ('<' <= c && c <= '>') || c == '*' || c == '/' || c == '#';
+}
+
+inline bool IsStrContains(int c) {
+    return IsStrBeg(c) || std::isdigit(c) || c == '?' || c == '!' || c == '-';
+}
+
+// Each function returns the first position in [pos, end) whose character is not of its class,
+// end if there is none. They check 16 or 32 bytes at a time with SSE2 or AVX2.
+const char* SkipSpace(const char* pos, const char* end);
+
+const char* SkipSymbolChars(const char* pos, const char* end);
+
+const char* SkipDigits(const char* pos, const char* end);
+
+// best level the CPU supports, the scanner starts with it
+ScanLevel GetMaxScanLevel();
+
+ScanLevel GetScanLevel();
+
+// switches the scanner of the whole process, meant for tests and benchmarks of the fallbacks
+void SetScanLevel(ScanLevel level);
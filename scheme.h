@@ -1,14 +1,45 @@
 #pragma once
 
 #include <string>
+#include "arena.h"
+#include "gc.h"
 #include "object.h"
+#include "parser.h"
+
+enum class Engine {
+    kTreeWalker,  // executes analyzed node tree
+    kBytecode,    // compiles to bytecode executed by virtual machine
+    kJit          // tree walker which compiles hot lambdas over integers to native code
+};
 
 class Interpreter {
 public:
-    Interpreter();
+    Interpreter(Engine engine = Engine::kTreeWalker);
+
+    // global variables are unbound, so that values which outlive the interpreter do not keep
+    // its scope alive
+    ~Interpreter();
 
     std::string Run(const std::string& input);
 
+    // collector and memory figures of the objects the interpreter created
+    HeapStats GetHeapStats() const;
+
+    // Run throws MemoryError once live objects would exceed the limit, 0 means no limit
+    void SetMemoryLimit(size_t bytes);
+
+    // Run throws SyntaxError for input nested deeper, see kMaxReadDepth
+    void SetMaxReadDepth(size_t depth);
+
+    // binding of a global variable, valid while the interpreter is alive
+    Binding* GetGlobal(const std::string& name);
+
 private:
+    Engine engine_;
+    size_t max_read_depth_ = kMaxReadDepth;
+    // declared first to be destroyed last, after everything the interpreter owns
+    Heap heap_;
+    // syntax tree of the input being run
+    Arena arena_;
     std::shared_ptr<Scope> global_;
 };
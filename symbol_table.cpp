@@ -0,0 +1,21 @@
+#include "symbol_table.h"
+
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+const InternedSymbol* InternSymbol(std::string_view name) {
+    static std::mutex mutex;
+    // deque never relocates its elements, so entry pointers and name views stay valid
+    static std::deque<InternedSymbol> symbols;
+    static std::unordered_map<std::string_view, const InternedSymbol*> index;
+
+    std::lock_guard lock(mutex);
+    if (auto it = index.find(name); it != index.end()) {
+        return it->second;
+    }
+    auto& symbol = symbols.emplace_back(
+        InternedSymbol{.id = static_cast<SymbolId>(symbols.size()), .name = std::string(name)});
+    index.emplace(symbol.name, &symbol);
+    return &symbol;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+using SymbolId = uint32_t;
+
+// Entry of the process-wide symbol table. Entries are never freed, so interned symbols can be
+// compared and hashed by id and referenced by pointer for the whole process lifetime.
+struct InternedSymbol {
+    SymbolId id;
+    std::string name;
+};
+
+// Returns the single entry for the name, adding it on first use. Thread-safe.
+const InternedSymbol* InternSymbol(std::string_view name);
@@ -7,6 +7,14 @@
 
 class SchemeTest {
 public:
+#ifdef SCHEME_TEST_BYTECODE
+    SchemeTest(Engine engine = Engine::kBytecode) : interpreter_(engine) {
+    }
+#else
+    SchemeTest(Engine engine = Engine::kTreeWalker) : interpreter_(engine) {
+    }
+#endif
+
     void ExpectEq(std::string expression, const std::string& result) {
         REQUIRE(interpreter_.Run(expression) == result);
     }
@@ -30,3 +38,15 @@ public:
 private:
     Interpreter interpreter_;
 };
+
+class BytecodeSchemeTest : public SchemeTest {
+public:
+    BytecodeSchemeTest() : SchemeTest(Engine::kBytecode) {
+    }
+};
+
+class JitSchemeTest : public SchemeTest {
+public:
+    JitSchemeTest() : SchemeTest(Engine::kJit) {
+    }
+};
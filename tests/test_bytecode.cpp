@@ -0,0 +1,28 @@
+#include "scheme_test.h"
+
+TEST_CASE_METHOD(BytecodeSchemeTest, "BytecodeBasics") {
+    ExpectEq("(+ 1 2 3)", "6");
+    ExpectEq("(if (< 1 2) 'yes 'no)", "yes");
+    ExpectEq("(and 1 #f (undefined))", "#f");
+    ExpectEq("(or #f 2 (undefined))", "2");
+    ExpectEq("((lambda (x y) (* x y)) 6 7)", "42");
+    ExpectRuntimeError("(1 2)");
+    ExpectNameError("undefined");
+}
+
+TEST_CASE_METHOD(BytecodeSchemeTest, "BytecodeInternalDefines") {
+    ExpectNoError("(define (f x) (define y (* x 2)) (define (g) (+ x y)) (g))");
+    ExpectEq("(f 5)", "15");
+    ExpectNameError("y");
+    ExpectNoError("(define (h) (define z z) z)");
+    ExpectNameError("(h)");
+}
+
+TEST_CASE_METHOD(BytecodeSchemeTest, "BytecodeTailCalls") {
+    ExpectNoError("(define (loop n acc) (if (= n 0) acc (loop (- n 1) (+ acc 1))))");
+    ExpectEq("(loop 1000000 0)", "1000000");
+
+    ExpectNoError("(define (even? n) (if (= n 0) #t (odd? (- n 1))))");
+    ExpectNoError("(define (odd? n) (if (= n 0) #f (even? (- n 1))))");
+    ExpectEq("(even? 100001)", "#f");
+}
@@ -12,3 +12,37 @@ TEST_CASE_METHOD(SchemeTest, "Be careful") {
     ExpectRuntimeError("('() ())");
     ExpectEq("'(())", "(())");
 }
+
+TEST_CASE_METHOD(SchemeTest, "QuoteForms") {
+    ExpectEq("(car (quote (1 2)))", "1");
+    ExpectEq("(car '(1 2))", "1");
+    ExpectEq("(symbol? (quote x))", "#t");
+    ExpectEq("(symbol? 'x)", "#t");
+    ExpectSyntaxError("(quote)");
+    ExpectSyntaxError("(quote 1 2)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "SyntaxIsCheckedBeforeEvaluation") {
+    ExpectSyntaxError("(define (f x) (if x))");
+    ExpectNameError("f");
+    ExpectSyntaxError("(if #f (lambda (x)))");
+}
+
+TEST_CASE_METHOD(SchemeTest, "BuiltinCallArities") {
+    ExpectNoError("(define x 2)");
+    ExpectEq("(abs x)", "2");
+    ExpectEq("(+ x 3)", "5");
+    ExpectEq("(* x x x)", "8");
+    ExpectEq("(< x 3 4 5 6)", "#t");
+    ExpectEq("(cons x (car (list x)))", "(2 . 2)");
+
+    // wide calls nested in the arguments of each other
+    ExpectEq("(+ x (+ x x x x x) x (* x (+ x x x x) 1) (- x x x x))", "26");
+    ExpectEq("(list x x (list x x x x) x)", "(2 2 (2 2 2 2) 2)");
+
+    ExpectRuntimeError("(car x x)");
+    ExpectRuntimeError("(cons x)");
+    ExpectRuntimeError("(+ x #t x x x)");
+    ExpectRuntimeError("(+ x (+ x x x #t) x x)");
+    ExpectEq("(max x 1 5 x 3)", "5");
+}
@@ -112,3 +112,11 @@ TEST_CASE_METHOD(SchemeTest, "IntegerAbsEdgeCases") {
     ExpectRuntimeError("(abs #t)");
     ExpectRuntimeError("(abs 1 2)");
 }
+
+TEST_CASE_METHOD(SchemeTest, "IntegersOutsideImmediateRange") {
+    ExpectEq("(* 2147483647 2147483647 2)", "9223372028264841218");
+    ExpectEq("(- 0 (* 2147483647 2147483647 2))", "-9223372028264841218");
+    ExpectEq("(- (* 2147483647 2147483647 2) (* 2147483647 2147483647))", "4611686014132420609");
+    ExpectEq("(= (* 2147483647 2147483647 2) (* 2 2147483647 2147483647))", "#t");
+    ExpectEq("(number? (* 2147483647 2147483647 2))", "#t");
+}
@@ -0,0 +1,79 @@
+#include "scheme_test.h"
+
+#include <sstream>
+
+#include <analyzer.h>
+#include <jit.h>
+#include <optimizer.h>
+#include <parser.h>
+
+TEST_CASE_METHOD(JitSchemeTest, "JitResults") {
+    ExpectNoError("(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+    ExpectEq("(fib 20)", "6765");
+    ExpectEq("(fib 1)", "1");
+
+    ExpectNoError(
+        "(define (tak x y z) (if (not (< y x)) z "
+        "(tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y))))");
+    ExpectEq("(tak 18 12 6)", "7");
+
+    // tail calls run in constant native stack
+    ExpectNoError("(define (sum n acc) (if (= n 0) acc (sum (- n 1) (+ acc n))))");
+    ExpectEq("(sum 1000000 0)", "500000500000");
+}
+
+TEST_CASE_METHOD(JitSchemeTest, "JitFallsBackToInterpreter") {
+    ExpectNoError("(define (pow2 n) (if (= n 0) 1 (* 2 (pow2 (- n 1)))))");
+    for (int i = 0; i < 100; ++i) {
+        ExpectEq("(pow2 10)", "1024");
+    }
+    ExpectEq("(pow2 62)", "4611686018427387904");
+    ExpectRuntimeError("(pow2 #t)");
+    ExpectRuntimeError("(pow2 1 2)");
+
+    ExpectNoError("(define (inc x) (+ x 1))");
+    for (int i = 0; i < 100; ++i) {
+        ExpectEq("(inc 5)", "6");
+    }
+    ExpectNoError("(define + -)");
+    ExpectEq("(inc 5)", "4");
+
+    ExpectNoError("(define neg (lambda (x) (- x)))");
+    for (int i = 0; i < 100; ++i) {
+        ExpectEq("(neg 7)", "7");
+    }
+
+    ExpectNoError("(define (down n) (if (= n 0) 0 (down (- n 1))))");
+    ExpectEq("(down 1000)", "0");
+    ExpectNoError("(define old-down down)");
+    ExpectNoError("(set! down (lambda (n) 'replaced))");
+    ExpectEq("(old-down 3)", "replaced");
+}
+
+TEST_CASE("JitCompilesHotLambdas") {
+    auto global = std::make_shared<Scope>(StringFuncMap{
+        {"+", MakeRef<Sum>()},
+        {"-", MakeRef<Dif>()},
+        {"<", MakeRef<Comp>("<")},
+        {"car", MakeRef<Car>()},
+    });
+    auto define = [&global](const std::string& source, const std::string& name) {
+        std::stringstream ss{source};
+        Tokenizer tokenizer{&ss};
+        Analyze(Optimize(Read(&tokenizer), global), global, true)->Execute(nullptr);
+        return As<LambdaCall>(global->ResolveSymbol(InternSymbol(name)->id));
+    };
+
+    auto fib = define("(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))", "fib");
+    auto first = define("(define (first x) (car x))", "first");
+    REQUIRE(fib->GetJitProfile());
+    for (size_t i = 0; i <= JitProfile::kHotCallCount; ++i) {
+        REQUIRE(fib->Apply({Value::Integer(10)}).GetInteger() == 55);
+        REQUIRE(first->Apply({MakeRef<Cell>(Value::Integer(1))}).GetInteger() == 1);
+    }
+#if defined(__x86_64__) && defined(__linux__)
+    REQUIRE(fib->GetJitProfile()->IsCompiled());
+#endif
+    REQUIRE_FALSE(first->GetJitProfile()->IsCompiled());
+    global->UnbindAll();
+}
@@ -160,3 +160,61 @@ TEST_CASE_METHOD(SchemeTest, "Redefinition and scoping") {
     ExpectEq("((foobar) 1 2)", "3");
     ExpectEq("(+ 1 2 -3)", "0");
 }
+
+TEST_CASE_METHOD(SchemeTest, "SetRebindsArgumentNotCaller") {
+    ExpectNoError("(define (f a) (set! a 5) a)");
+    ExpectNoError("(define z 1)");
+    ExpectEq("(f z)", "5");
+    ExpectEq("z", "1");
+}
+
+TEST_CASE_METHOD(SchemeTest, "LexicalScoping") {
+    ExpectNoError("(define x 'global)");
+    ExpectNoError("(define (f x) (lambda () x))");
+    ExpectEq("((f 1))", "1");
+
+    ExpectNoError("(define (g) (define x 5) (set! x (+ x 1)) x)");
+    ExpectEq("(g)", "6");
+    ExpectEq("x", "global");
+
+    ExpectNoError("(define (outer a) (lambda (b) (lambda (c) (+ a b c))))");
+    ExpectEq("(((outer 1) 2) 3)", "6");
+
+    ExpectNoError("(define (h) (define y y) y)");
+    ExpectNameError("(h)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "TailCalls") {
+    ExpectNoError("(define (count n acc) (if (= n 0) acc (count (- n 1) (+ acc 1))))");
+    ExpectEq("(count 10000000 0)", "10000000");
+
+    ExpectNoError("(define (even? n) (if (= n 0) #t (odd? (- n 1))))");
+    ExpectNoError("(define (odd? n) (if (= n 0) #f (even? (- n 1))))");
+    ExpectEq("(even? 1000001)", "#f");
+
+    ExpectNoError("(define (all-positive n) (or (= n 0) (and (> n 0) (all-positive (- n 1)))))");
+    ExpectEq("(all-positive 1000000)", "#t");
+
+    ExpectNoError(
+        "(define (sum-to n) (define (iter i acc) (if (> i n) acc (iter (+ i 1) (+ acc i)))) "
+        "(iter 1 0))");
+    ExpectEq("(sum-to 1000000)", "500000500000");
+}
+
+TEST_CASE_METHOD(SchemeTest, "ClosuresKeepCapturedFrames") {
+    ExpectNoError("(define (make-adder n) (lambda (x) (+ x n)))");
+    ExpectNoError("(define add1 (make-adder 1))");
+    ExpectNoError("(define (square x) (* x x))");
+    ExpectEq("(square 7)", "49");
+    ExpectNoError("(define add2 (make-adder 2))");
+    ExpectEq("(square 8)", "64");
+    ExpectEq("(add1 10)", "11");
+    ExpectEq("(add2 10)", "12");
+
+    ExpectNoError("(define (pair-of-counters) (define n 0) (cons (lambda () (set! n (+ n 1)) n) "
+                  "(lambda () n)))");
+    ExpectNoError("(define counters (pair-of-counters))");
+    ExpectEq("((car counters))", "1");
+    ExpectEq("((car counters))", "2");
+    ExpectEq("((cdr counters))", "2");
+}
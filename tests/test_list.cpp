@@ -78,3 +78,13 @@ TEST_CASE_METHOD(SchemeTest, "ListOperations") {
     ExpectRuntimeError("(list-ref '(1 2 3) 10)");
     ExpectRuntimeError("(list-tail '(1 2 3) 10)");
 }
+
+TEST_CASE_METHOD(SchemeTest, "EmptyListAsElement") {
+    ExpectEq("(cons 1 '())", "(1)");
+    ExpectEq("(cons 1 (cons 2 '()))", "(1 2)");
+    ExpectEq("(cons '() 2)", "(() . 2)");
+    ExpectEq("(car '(() 1))", "()");
+    ExpectEq("(list (list))", "(())");
+    ExpectEq("(pair? '(1 2 3))", "#t");
+    ExpectEq("(null? (cdr '(1)))", "#t");
+}
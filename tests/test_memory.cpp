@@ -0,0 +1,390 @@
+#include "scheme_test.h"
+
+#include <sstream>
+#include <thread>
+
+#include <analyzer.h>
+#include <arena.h>
+#include <optimizer.h>
+#include <parser.h>
+#include <pool.h>
+#include <vm.h>
+
+class AllocationTest {
+public:
+    AllocationTest()
+        : global_(std::make_shared<Scope>(StringFuncMap{
+              {"+", MakeRef<Sum>()},
+              {"*", MakeRef<Prod>()},
+              {"car", MakeRef<Car>()},
+              {"cons", MakeRef<Cons>()},
+          })) {
+    }
+
+    // number of heap objects created by evaluation of the source, parsing excluded
+    uint64_t CountAllocations(const std::string& source) {
+        auto ast = ReadSource(source);
+        auto node = Analyze(ast, global_);
+        auto code = Compile(ast, global_);
+        VirtualMachine vm(global_);
+
+        auto before = Object::GetAllocationCount();
+        auto tree_result = node->Execute(nullptr);
+        auto tree_count = Object::GetAllocationCount() - before;
+
+        before = Object::GetAllocationCount();
+        auto vm_result = vm.Run(code);
+        REQUIRE(Object::GetAllocationCount() - before == tree_count);
+        REQUIRE(tree_result.Serialize() == vm_result.Serialize());
+        return tree_count;
+    }
+
+    Value Evaluate(const std::string& source) {
+        return Analyze(ReadSource(source), global_)->Execute(nullptr);
+    }
+
+    size_t CountConstants(const std::string& source) {
+        return Compile(ReadSource(source), global_)->constants.size();
+    }
+
+private:
+    static Value ReadSource(const std::string& source) {
+        std::stringstream ss{source};
+        Tokenizer tokenizer{&ss};
+        return Read(&tokenizer);
+    }
+
+    std::shared_ptr<Scope> global_;
+};
+
+TEST_CASE_METHOD(AllocationTest, "EvaluationAllocatesOnlyResults") {
+    REQUIRE(CountAllocations("(+ 1 2)") == 0);
+    REQUIRE(CountAllocations("(+ 1 (+ 2 3) 4 5 6)") == 0);
+    REQUIRE(CountAllocations("(car '(1 2))") == 0);
+    REQUIRE(CountAllocations("#t") == 0);
+    REQUIRE(CountAllocations("+") == 0);
+
+    // integers outside the immediate range and pairs are heap objects
+    REQUIRE(CountAllocations("(* 2147483647 2147483647 2)") == 1);
+    REQUIRE(CountAllocations("(cons 1 2)") == 1);
+}
+
+TEST_CASE_METHOD(AllocationTest, "BuiltinsAreSharedByReference") {
+    auto sum = Evaluate("+");
+    REQUIRE(sum.GetObject() != nullptr);
+    REQUIRE(Evaluate("+").GetObject() == sum.GetObject());
+}
+
+TEST_CASE_METHOD(AllocationTest, "RepeatedLiteralsShareConstants") {
+    REQUIRE(CountConstants("(+ 1 2 1 2 1)") == 2);
+    REQUIRE(CountConstants("(cons #t (cons #t (cons 'a 'a)))") == 2);
+    // quoted lists may be mutated with set-car!, equal ones stay distinct
+    REQUIRE(CountConstants("(cons '(1) '(1))") == 2);
+    // lambdas have pools of their own
+    REQUIRE(CountConstants("(f 1 ((lambda () (f 2 2))) 1)") == 1);
+
+    std::string call = "(f";
+    for (int i = 0; i < 100000; ++i) {
+        call += " " + std::to_string(i % 20000);
+    }
+    REQUIRE(CountConstants(call + ")") == 20000);
+}
+
+TEST_CASE("ValuesCountTheirOwners") {
+    Value cell = MakeRef<Cell>(Value::Integer(1));
+    REQUIRE(cell.IsUnique());
+    {
+        auto copy = cell;
+        REQUIRE(cell.GetObject()->GetRefCount() == 2);
+        copy = Value::Integer(2);
+        REQUIRE(cell.IsUnique());
+    }
+    auto moved = std::move(cell);
+    REQUIRE(moved.IsUnique());
+    REQUIRE_FALSE(Value::Integer(1).IsUnique());
+
+    Binding binding;
+    binding.Define(moved);
+    BindingGuard guard(&binding);
+    REQUIRE(guard.IsValid());
+    binding.Set(moved);
+    REQUIRE_FALSE(guard.IsValid());
+}
+
+TEST_CASE_METHOD(SchemeTest, "CollectCycles") {
+    ExpectEq("(gc)", "0");
+    ExpectNoError("(define x '(1 . 2))");
+    ExpectNoError("(set-cdr! x x)");
+    ExpectNoError("(define x 0)");
+    ExpectEq("(gc)", "1");
+
+    // closure stored in the frame it captures
+    ExpectNoError("(define (make) (define (loop n) (if (= n 0) 0 (loop (- n 1)))) loop)");
+    ExpectEq("((make) 10)", "0");
+    ExpectEq("(gc)", "2");
+
+    // cycles reachable from globals survive
+    ExpectNoError("(define counter (make))");
+    ExpectNoError("(define y '(1 2))");
+    ExpectNoError("(set-cdr! (cdr y) y)");
+    ExpectEq("(gc)", "0");
+    ExpectEq("(counter 5)", "0");
+    ExpectEq("(car (cdr (cdr y)))", "1");
+    ExpectRuntimeError("(gc 1)");
+}
+
+// Builtin which reports its destruction.
+class DestructionProbe : public Function {
+public:
+    explicit DestructionProbe(bool* destroyed) : destroyed_(destroyed) {
+    }
+
+    ~DestructionProbe() override {
+        *destroyed_ = true;
+    }
+
+    std::string Serialize() override {
+        return "probe";
+    }
+
+    Value Apply(const ObjectList&) override {
+        return Value();
+    }
+
+private:
+    bool* destroyed_;
+};
+
+TEST_CASE("InterpreterFreesItsCycles") {
+    for (auto engine : {Engine::kTreeWalker, Engine::kBytecode}) {
+        bool in_function = false;
+        bool in_pair = false;
+        {
+            Interpreter interpreter(engine);
+            interpreter.GetGlobal("p1")->Define(MakeRef<DestructionProbe>(&in_function));
+            interpreter.GetGlobal("p2")->Define(MakeRef<DestructionProbe>(&in_pair));
+            interpreter.Run("(define (f n) (if (= n 0) p1 (f (- n 1))))");
+            interpreter.Run("(define x (cons p2 1))");
+            interpreter.Run("(set-cdr! x x)");
+            interpreter.Run("(define p2 0)");
+            REQUIRE(interpreter.Run("(f 3)") == "probe");
+            REQUIRE(interpreter.GetHeapStats().collections == 0);
+        }
+        REQUIRE(in_function);
+        REQUIRE(in_pair);
+    }
+}
+
+TEST_CASE("CollectionIsAutomatic") {
+    Interpreter interpreter;
+    interpreter.Run("(define (make) (define (loop n) (if (= n 0) 0 (loop (- n 1)))) loop)");
+    for (size_t i = 0; i < Heap::kYoungLimit; ++i) {
+        interpreter.Run("((make) 1)");
+    }
+    auto stats = interpreter.GetHeapStats();
+    REQUIRE(stats.young_collections > 0);
+    REQUIRE(stats.freed_total > 0);
+    REQUIRE(stats.tracked < Heap::kYoungLimit);
+}
+
+TEST_CASE("YoungCollectionsKeepLiveNodes") {
+    Interpreter interpreter;
+    interpreter.Run("(define (make) (define (loop n) (if (= n 0) 0 (loop (- n 1)))) loop)");
+    interpreter.Run("(define old (cons 1 2))");
+    interpreter.Run("(gc)");
+
+    // each call leaves a dead cycle, young collections run while the loop is going on
+    interpreter.Run("(define (churn n) ((make) 1) (if (= n 0) 0 (churn (- n 1))))");
+    interpreter.Run("(set-cdr! old (list 3 4))");
+    interpreter.Run("(define (grow n acc) (if (= n 0) acc (grow (- n 1) (cons n acc))))");
+    interpreter.Run("(define young (grow 10 '()))");
+    REQUIRE(interpreter.Run("(churn 10000)") == "0");
+
+    auto stats = interpreter.GetHeapStats();
+    REQUIRE(stats.young_collections > 0);
+    REQUIRE(stats.tracked < 2 * Heap::kYoungLimit);
+    REQUIRE(interpreter.Run("old") == "(1 3 4)");
+    REQUIRE(interpreter.Run("young") == "(1 2 3 4 5 6 7 8 9 10)");
+}
+
+TEST_CASE("LongListsAreFreed") {
+    Interpreter interpreter;
+    interpreter.Run("(define (grow n acc) (if (= n 0) acc (grow (- n 1) (cons n acc))))");
+    interpreter.Run("(define data (grow 1000000 '()))");
+    REQUIRE(interpreter.Run("(car data)") == "1");
+    interpreter.Run("(define data '())");
+}
+
+TEST_CASE("PoolsReuseFreedObjects") {
+    auto cells = [] {
+        return ObjectPool::GetStats()[(sizeof(Cell) - 1) / ObjectPool::kGranularity];
+    };
+    auto before = cells();
+    {
+        Interpreter interpreter;
+        interpreter.Run("(define (grow n acc) (if (= n 0) acc (grow (- n 1) (cons n acc))))");
+        interpreter.Run("(define data (grow 10000 '()))");
+        REQUIRE(cells().live >= before.live + 10000);
+        interpreter.Run("(define data '())");
+        interpreter.Run("(define data (grow 10000 '()))");
+        REQUIRE(cells().hits >= before.hits + 10000);
+    }
+    auto after = cells();
+    REQUIRE(after.block_size >= sizeof(Cell));
+    REQUIRE(after.live == before.live);
+    REQUIRE(after.capacity >= after.live);
+}
+
+TEST_CASE("ExitedThreadsHandOverTheirBlocks") {
+    auto run = [](PoolStats* stats) {
+        {
+            Interpreter interpreter;
+            interpreter.Run("(define (grow n acc) (if (= n 0) acc (grow (- n 1) (cons n acc))))");
+            interpreter.Run("(define data (grow 10000 '()))");
+        }
+        *stats = ObjectPool::GetStats()[(sizeof(Cell) - 1) / ObjectPool::kGranularity];
+    };
+    PoolStats first;
+    std::thread(run, &first).join();
+    PoolStats second;
+    std::thread(run, &second).join();
+    // the second thread starts with the blocks the first one left
+    REQUIRE(first.capacity >= 10000);
+    REQUIRE(second.hits >= 10000);
+}
+
+TEST_CASE("BlocksFreedByOtherThreadsAreCounted") {
+    auto cells = [] {
+        return ObjectPool::GetStats()[(sizeof(Cell) - 1) / ObjectPool::kGranularity];
+    };
+    auto before = cells();
+    Value list;
+    std::thread([&list] {
+        for (int i = 0; i < 100; ++i) {
+            list = MakeRef<Cell>(Value::Integer(i), std::move(list));
+        }
+    }).join();
+    REQUIRE(cells().live == before.live + 100);
+    list = Value();
+    REQUIRE(cells().live == before.live);
+}
+
+TEST_CASE("MemoryLimitStopsRunawayAllocation") {
+    for (auto engine : {Engine::kTreeWalker, Engine::kBytecode}) {
+        Interpreter interpreter(engine);
+        interpreter.Run("(define (grow n acc) (if (= n 0) acc (grow (- n 1) (cons n acc))))");
+        auto before = interpreter.GetHeapStats();
+        REQUIRE(before.live_bytes > 0);
+        REQUIRE(before.allocated_bytes >= before.live_bytes);
+
+        constexpr size_t kLimit = 1 << 20;
+        interpreter.SetMemoryLimit(kLimit);
+        REQUIRE_THROWS_AS(interpreter.Run("(grow 1000000 '())"), MemoryError);
+        auto after = interpreter.GetHeapStats();
+        REQUIRE(after.peak_bytes <= kLimit);
+        REQUIRE(after.peak_bytes > kLimit - 1024);
+        REQUIRE(after.limit_bytes == kLimit);
+        // the partial list is freed while the error unwinds, the interpreter keeps working
+        REQUIRE(after.live_bytes < before.live_bytes + 1024);
+        REQUIRE(interpreter.Run("(car (grow 10 '()))") == "1");
+
+        interpreter.SetMemoryLimit(0);
+        REQUIRE(interpreter.Run("(car (grow 100000 '()))") == "1");
+    }
+}
+
+TEST_CASE("PooledFramesAreChargedToTheirUser") {
+    // a thread of its own starts with an empty frame pool
+    std::thread([] {
+        Interpreter first;
+        Interpreter second;
+        for (auto interpreter : {&first, &second}) {
+            interpreter->Run("(define (depth n) (if (= n 0) 0 (+ 1 (depth (- n 1)))))");
+        }
+        auto first_baseline = first.GetHeapStats().live_bytes;
+        auto second_baseline = second.GetHeapStats().live_bytes;
+
+        REQUIRE(first.Run("(depth 100)") == "100");
+        REQUIRE(first.GetHeapStats().live_bytes == first_baseline);
+        REQUIRE(second.Run("(depth 100)") == "100");
+        REQUIRE(second.GetHeapStats().live_bytes == second_baseline);
+        REQUIRE(first.GetHeapStats().live_bytes == first_baseline);
+    }).join();
+}
+
+TEST_CASE_METHOD(SchemeTest, "MemoryStats") {
+    ExpectEq("(car (car (memory-stats)))", "allocated");
+    ExpectEq("(car (list-ref (memory-stats) 3))", "limit");
+    ExpectEq("(cdr (list-ref (memory-stats) 3))", "0");
+    ExpectNoError("(define data (list 1 2 3))");
+    ExpectEq("(<= 1 (cdr (list-ref (memory-stats) 1)) (cdr (list-ref (memory-stats) 2)))", "#t");
+    ExpectRuntimeError("(memory-stats 1)");
+}
+
+TEST_CASE("PairsAreCompact") {
+    // header, collector links and two tagged values, three pairs share a cache line and a half
+    REQUIRE(sizeof(Cell) <= 48);
+    REQUIRE(sizeof(GcNode) <= 16);
+
+    Value list = MakeRef<Cell>(Value::Integer(1), MakeRef<Cell>(Value::Integer(2)));
+    REQUIRE(list.Serialize() == "(1 2)");
+    REQUIRE(list.IsUnique());
+    REQUIRE(As<Cell>(list)->GetSecond().IsUnique());
+}
+
+TEST_CASE("ArenaTreesArePromoted") {
+    Arena arena;
+    std::stringstream ss{"(a (b 1) . c)"};
+    Tokenizer tokenizer{&ss};
+    auto tree = Read(&tokenizer, &arena);
+    REQUIRE(tree.GetObject()->IsArenaAllocated());
+    auto copy = Arena::Promote(tree);
+    REQUIRE_FALSE(copy.GetObject()->IsArenaAllocated());
+    REQUIRE(Arena::Promote(copy).GetObject() == copy.GetObject());
+    tree = Value();
+    arena.Reset();
+    REQUIRE(copy.Serialize() == "(a (b 1) . c)");
+
+    // quoted data is kept by the code, the reader puts it on the heap
+    std::stringstream quoted{"(quote (1 2))"};
+    Tokenizer quoted_tokenizer{&quoted};
+    tree = Read(&quoted_tokenizer, &arena);
+    REQUIRE(tree.GetObject()->IsArenaAllocated());
+    auto datum = As<Cell>(As<Cell>(tree)->GetSecond())->GetFirst();
+    REQUIRE_FALSE(datum.GetObject()->IsArenaAllocated());
+    tree = Value();
+    arena.Reset();
+
+    // data kept by definitions outlives the input it was read from
+    Interpreter interpreter;
+    interpreter.Run("(define x '(1 (2 3) . 4))");
+    interpreter.Run("(define (get) '(5 6))");
+    REQUIRE_FALSE(interpreter.GetGlobal("x")->Get().GetObject()->IsArenaAllocated());
+    REQUIRE(interpreter.Run("x") == "(1 (2 3) . 4)");
+    REQUIRE(interpreter.Run("(get)") == "(5 6)");
+    interpreter.Run("(define (seven) (+ 3 4))");
+    interpreter.Run("(define + -)");
+    REQUIRE(interpreter.Run("(seven)") == "-1");
+}
+
+TEST_CASE("OptimizerKeepsUnchangedTrees") {
+    auto global = std::make_shared<Scope>(StringFuncMap{{"+", MakeRef<Sum>()}});
+    Arena arena;
+    std::stringstream ss{"(if x (+ x (f 1 2) (lambda (y) (+ y 1))) (set! x (+ 1 2)))"};
+    Tokenizer tokenizer{&ss};
+    auto tree = Read(&tokenizer, &arena);
+    auto branch = As<Cell>(As<Cell>(tree)->GetSecond())->GetSecond();
+    auto call = As<Cell>(branch)->GetFirst();
+
+    auto before = Object::GetAllocationCount();
+    auto same = Optimize(call, global);
+    REQUIRE(Object::GetAllocationCount() == before);
+    REQUIRE(same.GetObject() == call.GetObject());
+
+    // only the spines leading to the folded call are copied
+    auto optimized = Optimize(tree, global);
+    REQUIRE_FALSE(optimized.GetObject()->IsArenaAllocated());
+    auto optimized_branch = As<Cell>(As<Cell>(optimized)->GetSecond())->GetSecond();
+    REQUIRE(As<Cell>(optimized_branch)->GetFirst().GetObject() == call.GetObject());
+    REQUIRE(optimized.Serialize() == tree.Serialize());
+}
@@ -0,0 +1,58 @@
+#include "scheme_test.h"
+
+TEST_CASE_METHOD(SchemeTest, "ConstantFolding") {
+    ExpectEq("(+ 1 (* 2 3) (- 10 (abs -4)))", "13");
+    ExpectEq("(max (min 3 4) 2)", "3");
+    ExpectEq("(not (< 1 2))", "#f");
+    ExpectEq("'(+ 1 2)", "(+ 1 2)");
+
+    // errors are left to execution
+    ExpectRuntimeError("(+ 1 #t)");
+    ExpectRuntimeError("(abs)");
+    ExpectSyntaxError("(+ 1 . 2)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "ConstantFoldingRespectsRebinding") {
+    ExpectNoError("(define (f) (+ 1 (* 2 3)))");
+    ExpectEq("(f)", "7");
+    ExpectNoError("(define + -)");
+    ExpectEq("(f)", "-5");
+    ExpectNoError("(set! * (lambda (x y) 100))");
+    ExpectEq("(f)", "-99");
+    ExpectEq("(+ 1 2)", "-1");
+
+    ExpectEq("((lambda (abs) (abs 1)) (lambda (x) 'local))", "local");
+    ExpectNoError("(define (g max) (max 1 2))");
+    ExpectEq("(g min)", "1");
+
+    ExpectNoError("(define (h) (set! min max) (min 1 2))");
+    ExpectEq("(h)", "2");
+}
+
+TEST_CASE_METHOD(SchemeTest, "ConstantConditions") {
+    ExpectEq("(if #f 1)", "()");
+    ExpectEq("(if 0 'yes 'no)", "yes");
+    ExpectEq("(if '#f 'yes 'no)", "no");
+    ExpectSyntaxError("(if #t 1 2 3)");
+    ExpectEq("(if #t 'kept (f (lambda (x) (define y x) y) (and) '(1 . 2)))", "kept");
+    ExpectSyntaxError("(if #t 1 (lambda (1) 2))");
+    ExpectSyntaxError("(if #f (set! 1 2) 3)");
+    ExpectSyntaxError("(if #t 1 (g (quote)))");
+
+    ExpectNoError("(define x 'global)");
+    ExpectNoError("(define (f) (if #t x (define x 'local)))");
+    ExpectNameError("(f)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "ConstantArgumentsOfAppliedLambdas") {
+    ExpectEq("((lambda (x y) (+ x (* y 2))) 1 2)", "5");
+    ExpectEq("((lambda (x) ((lambda () x))) 'sym)", "sym");
+    ExpectEq("(((lambda (x) (lambda (x) x)) 1) 5)", "5");
+    ExpectEq("((lambda (x) (set! x (+ x 1)) x) 1)", "2");
+    ExpectEq("((lambda (x) (define y x) (list x y)) '(1))", "((1) (1))");
+    ExpectEq("((lambda (x) (if x 'yes 'no)) #f)", "no");
+
+    ExpectNoError("(define y 10)");
+    ExpectEq("((lambda (x z) (+ x z)) 1 y)", "11");
+    ExpectRuntimeError("((lambda (x) x) 1 2)");
+}
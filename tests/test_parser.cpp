@@ -1,9 +1,11 @@
 #include <catch.hpp>
 
 #include <sstream>
+#include <thread>
 
 #include <error.h>
 #include <parser.h>
+#include <scheme.h>
 
 auto ReadFull(const std::string& str) {
     std::stringstream ss{str};
@@ -51,6 +53,23 @@ TEST_CASE("Read symbol") {
     }
 }
 
+TEST_CASE("Symbols are interned") {
+    auto first = ReadFull("foo");
+    auto second = ReadFull("foo");
+    REQUIRE(As<Symbol>(first)->GetId() == As<Symbol>(second)->GetId());
+    REQUIRE(&As<Symbol>(first)->GetName() == &As<Symbol>(second)->GetName());
+    REQUIRE(As<Symbol>(first)->GetId() != As<Symbol>(ReadFull("bar"))->GetId());
+}
+
+TEST_CASE("Type checks") {
+    auto number = ReadFull("5");
+    REQUIRE(Is<Number>(number));
+    REQUIRE(!Is<Symbol>(number));
+    REQUIRE(!Is<Function>(number));
+    REQUIRE(As<Cell>(number) == nullptr);
+    REQUIRE(!Is<Cell>(ReadFull("()")));
+}
+
 TEST_CASE("Lists") {
     SECTION("Empty list") {
         auto null = ReadFull("()");
@@ -154,3 +173,77 @@ TEST_CASE("Invalid") {
     REQUIRE_THROWS_AS(ReadFull("(1 . )"), SyntaxError);
     REQUIRE_THROWS_AS(ReadFull("(1 . 2 3)"), SyntaxError);
 }
+
+static std::string Nested(size_t depth, const std::string& inner) {
+    return std::string(depth, '(') + inner + std::string(depth, ')');
+}
+
+TEST_CASE("Long lists are read without recursion") {
+    std::string input = "(";
+    for (int i = 0; i < 1000000; ++i) {
+        input += "1 ";
+    }
+    input += ". 2)";
+    std::stringstream ss{input};
+    Tokenizer tokenizer{&ss};
+    auto list = Read(&tokenizer);
+
+    size_t length = 0;
+    const Value* rest = &list;
+    for (; Is<Cell>(*rest); rest = &As<Cell>(*rest)->GetSecond()) {
+        ++length;
+    }
+    REQUIRE(length == 1000000);
+    REQUIRE(As<Number>(*rest)->GetValue() == 2);
+}
+
+TEST_CASE("Nesting is limited") {
+    ReadFull(Nested(kMaxReadDepth, "1"));
+    ReadFull(Nested(kMaxReadDepth - 1, "'x"));
+    REQUIRE_THROWS_AS(ReadFull(Nested(kMaxReadDepth + 1, "")), SyntaxError);
+    REQUIRE_THROWS_AS(ReadFull(std::string(kMaxReadDepth + 1, '\'') + "x"), SyntaxError);
+    // the limit is reached long before the stack or the input ends
+    REQUIRE_THROWS_AS(ReadFull(std::string(10000000, '(')), SyntaxError);
+
+    std::stringstream ss{Nested(5000, "")};
+    Tokenizer tokenizer{&ss};
+    REQUIRE_THROWS_AS(Read(&tokenizer, nullptr, 4999), SyntaxError);
+    std::stringstream deeper{Nested(5000, "")};
+    Tokenizer deeper_tokenizer{&deeper};
+    REQUIRE(Is<Cell>(Read(&deeper_tokenizer, nullptr, 5000)));
+}
+
+TEST_CASE("Interpreter limits nesting") {
+    for (auto engine : {Engine::kTreeWalker, Engine::kBytecode}) {
+        Interpreter interpreter(engine);
+        auto data = "(car (car '" + Nested(kMaxReadDepth - 3, "1") + "))";
+        REQUIRE(interpreter.Run(data) == Nested(kMaxReadDepth - 5, "1"));
+
+        std::string sum = "1";
+        for (size_t i = 0; i + 1 < kMaxReadDepth; ++i) {
+            sum = "(+ 1 " + sum + ")";
+        }
+        REQUIRE(interpreter.Run(sum) == std::to_string(kMaxReadDepth));
+
+        interpreter.SetMaxReadDepth(10);
+        REQUIRE_THROWS_AS(interpreter.Run(Nested(11, "")), SyntaxError);
+        REQUIRE(interpreter.Run("'" + Nested(9, "")) == Nested(9, ""));
+    }
+}
+
+TEST_CASE("Interpreters read on separate threads") {
+    // objects shared by the reader are per thread, their counts aren't atomic
+    auto run = [](std::string* result) {
+        Interpreter interpreter;
+        for (int i = 0; i < 1000; ++i) {
+            *result = interpreter.Run("(cons (car '(1 . 2)) (if #f 3))");
+        }
+    };
+    std::string first;
+    std::string second;
+    std::thread thread(run, &first);
+    run(&second);
+    thread.join();
+    REQUIRE(first == "(1)");
+    REQUIRE(second == "(1)");
+}
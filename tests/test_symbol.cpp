@@ -57,3 +57,23 @@ TEST_CASE_METHOD(SchemeTest, "CopySemantics") {
 TEST_CASE_METHOD(SchemeTest, "EvaluationOrder") {
     ExpectNameError("(define x x)");
 }
+
+TEST_CASE_METHOD(SchemeTest, "RebindingGlobalsSeenByCompiledCode") {
+    // bodies refer to globals which are not defined yet
+    ExpectNoError("(define (f) (g 1))");
+    ExpectNoError("(define (h) (set! counter (+ counter 1)))");
+    ExpectNameError("(f)");
+    ExpectNameError("(h)");
+
+    ExpectNoError("(define (g x) (+ x 1))");
+    ExpectEq("(f)", "2");
+    ExpectNoError("(define (g x) (* x 10))");
+    ExpectEq("(f)", "10");
+    ExpectNoError("(set! g (lambda (x) 'replaced))");
+    ExpectEq("(f)", "replaced");
+
+    ExpectNoError("(define counter 0)");
+    ExpectNoError("(h)");
+    ExpectNoError("(h)");
+    ExpectEq("counter", "2");
+}
@@ -1,9 +1,14 @@
 #include <catch.hpp>
 
 #include <error.h>
+#include <mapped_file.h>
+#include <scanner.h>
 #include <tokenizer.h>
 
+#include <filesystem>
+#include <fstream>
 #include <sstream>
+#include <vector>
 
 TEST_CASE("Tokenizer works on simple case") {
     std::stringstream ss{"4+)'."};
@@ -160,3 +165,77 @@ void ShouldThrow() {
 TEST_CASE("Exception is thrown") {
     REQUIRE_THROWS_AS(ShouldThrow(), SyntaxError);
 }
+
+static std::vector<Token> ReadAll(Tokenizer* tokenizer) {
+    std::vector<Token> tokens;
+    for (; !tokenizer->IsEnd(); tokenizer->Next()) {
+        tokens.push_back(tokenizer->GetToken());
+    }
+    return tokens;
+}
+
+TEST_CASE("Buffers are tokenized in place") {
+    for (std::string input : {"(define (f x) (+ x -12 +3 '(a . b) #t #f zog-zog?))", "abc",
+                              "  - + 7\n", ""}) {
+        std::stringstream ss{input};
+        Tokenizer stream_tokenizer{&ss};
+        Tokenizer buffer_tokenizer{std::string_view{input}};
+        REQUIRE(ReadAll(&buffer_tokenizer) == ReadAll(&stream_tokenizer));
+    }
+
+    std::string_view source = "1@";
+    Tokenizer tokenizer{source};
+    REQUIRE(tokenizer.GetToken() == Token{ConstantToken{1}});
+    REQUIRE_THROWS_AS(tokenizer.Next(), SyntaxError);
+}
+
+TEST_CASE("Mapped files are tokenized in place") {
+    auto path = std::filesystem::temp_directory_path() / "scheme_tokenizer_test.scm";
+    std::ofstream(path) << "(1 foo)\n";
+    {
+        MappedFile file(path.string());
+        Tokenizer tokenizer{file.GetContent()};
+        REQUIRE(ReadAll(&tokenizer) == std::vector<Token>{BracketToken::OPEN, ConstantToken{1},
+                                                          SymbolToken{"foo"}, BracketToken::CLOSE});
+    }
+    std::filesystem::remove(path);
+
+    REQUIRE_THROWS_AS(MappedFile((path / "missing").string()), RuntimeError);
+}
+
+TEST_CASE("Scan levels agree with the scalar scanner") {
+    std::string text;
+    for (int c = 0; c < 256; ++c) {
+        text += static_cast<char>(c);
+    }
+    for (auto level : {ScanLevel::kScalar, ScanLevel::kSse2, ScanLevel::kAvx2}) {
+        if (level > GetMaxScanLevel()) {
+            continue;
+        }
+        SetScanLevel(level);
+        // runs of every length end at every byte value, the vector paths see all of them
+        for (size_t length : {0, 1, 15, 16, 17, 31, 32, 33, 70}) {
+            for (int c = 0; c < 256; ++c) {
+                std::string run = std::string(length, ' ') + static_cast<char>(c) + "  ";
+                auto stop = run.data() + length + (std::isspace(c) ? 3 : 0);
+                REQUIRE(SkipSpace(run.data(), run.data() + run.size()) == stop);
+
+                run = std::string(length, 'a') + static_cast<char>(c) + "..";
+                stop = run.data() + length + (IsStrContains(c) ? 1 : 0);
+                REQUIRE(SkipSymbolChars(run.data(), run.data() + run.size()) == stop);
+
+                run = std::string(length, '7') + static_cast<char>(c) + "..";
+                stop = run.data() + length + (std::isdigit(c) ? 1 : 0);
+                REQUIRE(SkipDigits(run.data(), run.data() + run.size()) == stop);
+            }
+        }
+
+        std::string input = "(define (long-name-of-a-function? x)\n" + std::string(40, ' ') +
+                            "(+ x -1234567 '(a . b) #t))";
+        std::stringstream ss{input};
+        Tokenizer stream_tokenizer{&ss};
+        Tokenizer buffer_tokenizer{std::string_view{input}};
+        REQUIRE(ReadAll(&buffer_tokenizer) == ReadAll(&stream_tokenizer));
+    }
+    SetScanLevel(GetMaxScanLevel());
+}
@@ -0,0 +1,94 @@
+#include <catch.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <error.h>
+#include <parser.h>
+#include <scheme.h>
+#include <transpiler/transpiler.h>
+
+#include "transpiler/fixture_transpiled.h"
+
+// Regenerate the expected output with
+//   transpiler tests/transpiler/fixture.scm tests/transpiler/fixture_transpiled.h RegisterFixture
+static const std::string kFixtureName = "tests/transpiler/fixture.scm";
+
+static std::string GetFixturePath(const std::string& name) {
+    std::string path = __FILE__;
+    return path.substr(0, path.find_last_of('/') + 1) + "transpiler/" + name;
+}
+
+static std::string ReadFile(const std::string& name) {
+    std::ifstream file(GetFixturePath(name));
+    REQUIRE(file);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+static std::string RunOrGetError(Interpreter* interpreter, const std::string& expression) {
+    try {
+        return interpreter->Run(expression);
+    } catch (const SyntaxError&) {
+        return "SyntaxError";
+    } catch (const NameError&) {
+        return "NameError";
+    } catch (const RuntimeError&) {
+        return "RuntimeError";
+    }
+}
+
+TEST_CASE("TranspiledFixtureIsUpToDate") {
+    std::stringstream source{ReadFile("fixture.scm")};
+    auto result = Transpile(&source, kFixtureName, "RegisterFixture");
+    REQUIRE(result.code == ReadFile("fixture_transpiled.h"));
+    // the counter and the closure factory stay with the interpreter
+    REQUIRE(result.compiled_count == 12);
+    REQUIRE(result.interpreted_count == 2);
+}
+
+TEST_CASE("TranspiledFunctionsMatchInterpreter") {
+    Interpreter compiled;
+    RegisterFixture(compiled);
+
+    Interpreter interpreted;
+    std::stringstream source{ReadFile("fixture.scm")};
+    Tokenizer tokenizer(&source);
+    while (!tokenizer.IsEnd()) {
+        interpreted.Run(ReadObject(&tokenizer).Serialize());
+    }
+
+    for (const std::string expression : {
+             "(fact 10)",
+             "(fact 20)",
+             "(count-down 1000000 0)",
+             "(both #f 1)",
+             "(both 1 #f)",
+             "(both 1 2)",
+             "(big)",
+             "(sum-list '(1 2 3 4))",
+             "(tag 1)",
+             "(tag 'a)",
+             "(tag #t)",
+             "(bump! 5)",
+             "(bump! 2)",
+             "counter",
+             "(local-define 4)",
+             "(use-before 1)",
+             "(max3 1 5 3)",
+             "((make-adder 3) 4)",
+             "(apply-twice (make-adder 10) 1)",
+             "(apply-twice fact 3)",
+             "(rename! (list 1 2))",
+             "(fact)",
+             "(fact 1 2)",
+             "(fact #t)",
+             "(sum-list 5)",
+             "(apply-twice 1 2)",
+         }) {
+        INFO(expression);
+        REQUIRE(RunOrGetError(&compiled, expression) == RunOrGetError(&interpreted, expression));
+    }
+}
@@ -0,0 +1,14 @@
+(define (fact n) (if (= n 0) 1 (* n (fact (- n 1)))))
+(define (count-down n acc) (if (= n 0) acc (count-down (- n 1) (+ acc 1))))
+(define (both a b) (and a (or b 7)))
+(define (big) (* 1073741824 1073741824))
+(define (sum-list l) (if (null? l) 0 (+ (car l) (sum-list (cdr l)))))
+(define (tag x) (if (number? x) 'number (if (symbol? x) 'symbol '(other thing))))
+(define counter 0)
+(define (bump! k) (set! counter (+ counter k)) counter)
+(define (local-define x) (define y (* x 2)) (define z (+ y 1)) (list x y z))
+(define (use-before x) (define y z) (define z x) y)
+(define max3 (lambda (a b c) (max a (max b c))))
+(define (make-adder n) (lambda (x) (+ x n)))
+(define (apply-twice f x) (f (f x)))
+(define (rename! p) (set-car! p 'changed) p)
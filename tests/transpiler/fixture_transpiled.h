@@ -0,0 +1,437 @@
+// Generated by transpiler from tests/transpiler/fixture.scm, do not edit.
+
+#include "transpiler/runtime.h"
+
+namespace {
+
+// fact
+class Compiled0 : public Function {
+public:
+    explicit Compiled0(Interpreter& interpreter)
+        : g0_(interpreter.GetGlobal("=")),
+          g1_(interpreter.GetGlobal("*")),
+          g2_(interpreter.GetGlobal("fact")),
+          g3_(interpreter.GetGlobal("-")) {
+    }
+
+    std::string Serialize() override {
+        throw SyntaxError("Compiled function should not be serialized");
+    }
+
+    Value Apply(const ObjectList& args) override {
+        CheckArgCount(args, 1);
+        Value v0 = args[0];  // n
+        while (true) {
+            Value t0 = g0_->Get();
+            Value t1 = v0;
+            Value t2 = CallFunction(t0, t1, Value::Integer(0));
+            if (IsTrue(t2)) {
+                return Value::Integer(1);
+            }
+            Value t3 = g1_->Get();
+            Value t4 = v0;
+            Value t5 = g2_->Get();
+            Value t6 = g3_->Get();
+            Value t7 = v0;
+            Value t8 = CallFunction(t6, t7, Value::Integer(1));
+            Value t9 = CallFunction(t5, t8);
+            return CallFunction(t3, t4, t9);
+        }
+    }
+
+private:
+    Binding* g0_;  // =
+    Binding* g1_;  // *
+    Binding* g2_;  // fact
+    Binding* g3_;  // -
+};
+
+// count-down
+class Compiled1 : public Function {
+public:
+    explicit Compiled1(Interpreter& interpreter)
+        : g0_(interpreter.GetGlobal("=")),
+          g1_(interpreter.GetGlobal("count-down")),
+          g2_(interpreter.GetGlobal("-")),
+          g3_(interpreter.GetGlobal("+")) {
+    }
+
+    std::string Serialize() override {
+        throw SyntaxError("Compiled function should not be serialized");
+    }
+
+    Value Apply(const ObjectList& args) override {
+        CheckArgCount(args, 2);
+        Value v0 = args[0];  // n
+        Value v1 = args[1];  // acc
+        while (true) {
+            Value t0 = g0_->Get();
+            Value t1 = v0;
+            Value t2 = CallFunction(t0, t1, Value::Integer(0));
+            if (IsTrue(t2)) {
+                Value t3 = v1;
+                return t3;
+            }
+            Value t4 = g1_->Get();
+            Value t5 = g2_->Get();
+            Value t6 = v0;
+            Value t7 = CallFunction(t5, t6, Value::Integer(1));
+            Value t8 = g3_->Get();
+            Value t9 = v1;
+            Value t10 = CallFunction(t8, t9, Value::Integer(1));
+            if (t4.GetObject() == this) {
+                v0 = std::move(t7);
+                v1 = std::move(t10);
+                continue;
+            }
+            return CallFunction(t4, t7, t10);
+        }
+    }
+
+private:
+    Binding* g0_;  // =
+    Binding* g1_;  // count-down
+    Binding* g2_;  // -
+    Binding* g3_;  // +
+};
+
+// both
+class Compiled2 : public Function {
+public:
+    explicit Compiled2(Interpreter&) {
+    }
+
+    std::string Serialize() override {
+        throw SyntaxError("Compiled function should not be serialized");
+    }
+
+    Value Apply(const ObjectList& args) override {
+        CheckArgCount(args, 2);
+        Value v0 = args[0];  // a
+        Value v1 = args[1];  // b
+        while (true) {
+            Value t0 = v0;
+            if (!IsTrue(t0)) {
+                return t0;
+            }
+            Value t1 = v1;
+            if (IsTrue(t1)) {
+                return t1;
+            }
+            return Value::Integer(7);
+        }
+    }
+};
+
+// big
+class Compiled3 : public Function {
+public:
+    explicit Compiled3(Interpreter& interpreter)
+        : g0_(interpreter.GetGlobal("*")) {
+    }
+
+    std::string Serialize() override {
+        throw SyntaxError("Compiled function should not be serialized");
+    }
+
+    Value Apply(const ObjectList& args) override {
+        CheckArgCount(args, 0);
+        while (true) {
+            Value t0 = g0_->Get();
+            return CallFunction(t0, Value::Integer(1073741824), Value::Integer(1073741824));
+        }
+    }
+
+private:
+    Binding* g0_;  // *
+};
+
+// sum-list
+class Compiled4 : public Function {
+public:
+    explicit Compiled4(Interpreter& interpreter)
+        : g0_(interpreter.GetGlobal("null?")),
+          g1_(interpreter.GetGlobal("+")),
+          g2_(interpreter.GetGlobal("car")),
+          g3_(interpreter.GetGlobal("sum-list")),
+          g4_(interpreter.GetGlobal("cdr")) {
+    }
+
+    std::string Serialize() override {
+        throw SyntaxError("Compiled function should not be serialized");
+    }
+
+    Value Apply(const ObjectList& args) override {
+        CheckArgCount(args, 1);
+        Value v0 = args[0];  // l
+        while (true) {
+            Value t0 = g0_->Get();
+            Value t1 = v0;
+            Value t2 = CallFunction(t0, t1);
+            if (IsTrue(t2)) {
+                return Value::Integer(0);
+            }
+            Value t3 = g1_->Get();
+            Value t4 = g2_->Get();
+            Value t5 = v0;
+            Value t6 = CallFunction(t4, t5);
+            Value t7 = g3_->Get();
+            Value t8 = g4_->Get();
+            Value t9 = v0;
+            Value t10 = CallFunction(t8, t9);
+            Value t11 = CallFunction(t7, t10);
+            return CallFunction(t3, t6, t11);
+        }
+    }
+
+private:
+    Binding* g0_;  // null?
+    Binding* g1_;  // +
+    Binding* g2_;  // car
+    Binding* g3_;  // sum-list
+    Binding* g4_;  // cdr
+};
+
+// tag
+class Compiled5 : public Function {
+public:
+    explicit Compiled5(Interpreter& interpreter)
+        : g0_(interpreter.GetGlobal("number?")),
+          g1_(interpreter.GetGlobal("symbol?")),
+          c0_(ReadDatum("number")),
+          c1_(ReadDatum("symbol")),
+          c2_(ReadDatum("(other thing)")) {
+    }
+
+    std::string Serialize() override {
+        throw SyntaxError("Compiled function should not be serialized");
+    }
+
+    Value Apply(const ObjectList& args) override {
+        CheckArgCount(args, 1);
+        Value v0 = args[0];  // x
+        while (true) {
+            Value t0 = g0_->Get();
+            Value t1 = v0;
+            Value t2 = CallFunction(t0, t1);
+            if (IsTrue(t2)) {
+                return c0_;
+            }
+            Value t3 = g1_->Get();
+            Value t4 = v0;
+            Value t5 = CallFunction(t3, t4);
+            if (IsTrue(t5)) {
+                return c1_;
+            }
+            return c2_;
+        }
+    }
+
+private:
+    Binding* g0_;  // number?
+    Binding* g1_;  // symbol?
+    Value c0_;
+    Value c1_;
+    Value c2_;
+};
+
+// bump!
+class Compiled6 : public Function {
+public:
+    explicit Compiled6(Interpreter& interpreter)
+        : g0_(interpreter.GetGlobal("+")),
+          g1_(interpreter.GetGlobal("counter")) {
+    }
+
+    std::string Serialize() override {
+        throw SyntaxError("Compiled function should not be serialized");
+    }
+
+    Value Apply(const ObjectList& args) override {
+        CheckArgCount(args, 1);
+        Value v0 = args[0];  // k
+        while (true) {
+            Value t0 = g0_->Get();
+            Value t1 = g1_->Get();
+            Value t2 = v0;
+            Value t3 = CallFunction(t0, t1, t2);
+            g1_->Set(t3);
+            Value t4 = g1_->Get();
+            return t4;
+        }
+    }
+
+private:
+    Binding* g0_;  // +
+    Binding* g1_;  // counter
+};
+
+// local-define
+class Compiled7 : public Function {
+public:
+    explicit Compiled7(Interpreter& interpreter)
+        : g0_(interpreter.GetGlobal("*")),
+          g1_(interpreter.GetGlobal("+")),
+          g2_(interpreter.GetGlobal("list")) {
+    }
+
+    std::string Serialize() override {
+        throw SyntaxError("Compiled function should not be serialized");
+    }
+
+    Value Apply(const ObjectList& args) override {
+        CheckArgCount(args, 1);
+        Value v0 = args[0];  // x
+        Value v1 = Value::Unbound();  // y
+        Value v2 = Value::Unbound();  // z
+        while (true) {
+            Value t0 = g0_->Get();
+            Value t1 = v0;
+            Value t2 = CallFunction(t0, t1, Value::Integer(2));
+            v1 = t2;
+            Value t3 = g1_->Get();
+            Value t4 = CheckBound(v1);
+            Value t5 = CallFunction(t3, t4, Value::Integer(1));
+            v2 = t5;
+            Value t6 = g2_->Get();
+            Value t7 = v0;
+            Value t8 = CheckBound(v1);
+            Value t9 = CheckBound(v2);
+            return CallFunction(t6, t7, t8, t9);
+        }
+    }
+
+private:
+    Binding* g0_;  // *
+    Binding* g1_;  // +
+    Binding* g2_;  // list
+};
+
+// use-before
+class Compiled8 : public Function {
+public:
+    explicit Compiled8(Interpreter&) {
+    }
+
+    std::string Serialize() override {
+        throw SyntaxError("Compiled function should not be serialized");
+    }
+
+    Value Apply(const ObjectList& args) override {
+        CheckArgCount(args, 1);
+        Value v0 = args[0];  // x
+        Value v1 = Value::Unbound();  // y
+        Value v2 = Value::Unbound();  // z
+        while (true) {
+            Value t0 = CheckBound(v2);
+            v1 = t0;
+            Value t1 = v0;
+            v2 = t1;
+            Value t2 = CheckBound(v1);
+            return t2;
+        }
+    }
+};
+
+// max3
+class Compiled9 : public Function {
+public:
+    explicit Compiled9(Interpreter& interpreter)
+        : g0_(interpreter.GetGlobal("max")) {
+    }
+
+    std::string Serialize() override {
+        throw SyntaxError("Compiled function should not be serialized");
+    }
+
+    Value Apply(const ObjectList& args) override {
+        CheckArgCount(args, 3);
+        Value v0 = args[0];  // a
+        Value v1 = args[1];  // b
+        Value v2 = args[2];  // c
+        while (true) {
+            Value t0 = g0_->Get();
+            Value t1 = v0;
+            Value t2 = g0_->Get();
+            Value t3 = v1;
+            Value t4 = v2;
+            Value t5 = CallFunction(t2, t3, t4);
+            return CallFunction(t0, t1, t5);
+        }
+    }
+
+private:
+    Binding* g0_;  // max
+};
+
+// apply-twice
+class Compiled10 : public Function {
+public:
+    explicit Compiled10(Interpreter&) {
+    }
+
+    std::string Serialize() override {
+        throw SyntaxError("Compiled function should not be serialized");
+    }
+
+    Value Apply(const ObjectList& args) override {
+        CheckArgCount(args, 2);
+        Value v0 = args[0];  // f
+        Value v1 = args[1];  // x
+        while (true) {
+            Value t0 = v0;
+            Value t1 = v0;
+            Value t2 = v1;
+            Value t3 = CallFunction(t1, t2);
+            return CallFunction(t0, t3);
+        }
+    }
+};
+
+// rename!
+class Compiled11 : public Function {
+public:
+    explicit Compiled11(Interpreter& interpreter)
+        : g0_(interpreter.GetGlobal("set-car!")),
+          c0_(ReadDatum("changed")) {
+    }
+
+    std::string Serialize() override {
+        throw SyntaxError("Compiled function should not be serialized");
+    }
+
+    Value Apply(const ObjectList& args) override {
+        CheckArgCount(args, 1);
+        Value v0 = args[0];  // p
+        while (true) {
+            Value t0 = g0_->Get();
+            Value t1 = v0;
+            Value t2 = CallFunction(t0, t1, c0_);
+            Value t3 = v0;
+            return t3;
+        }
+    }
+
+private:
+    Binding* g0_;  // set-car!
+    Value c0_;
+};
+
+}  // namespace
+
+void RegisterFixture(Interpreter& interpreter) {
+    interpreter.GetGlobal("fact")->Define(MakeRef<Compiled0>(interpreter));
+    interpreter.GetGlobal("count-down")->Define(MakeRef<Compiled1>(interpreter));
+    interpreter.GetGlobal("both")->Define(MakeRef<Compiled2>(interpreter));
+    interpreter.GetGlobal("big")->Define(MakeRef<Compiled3>(interpreter));
+    interpreter.GetGlobal("sum-list")->Define(MakeRef<Compiled4>(interpreter));
+    interpreter.GetGlobal("tag")->Define(MakeRef<Compiled5>(interpreter));
+    interpreter.Run("(define counter 0)");
+    interpreter.GetGlobal("bump!")->Define(MakeRef<Compiled6>(interpreter));
+    interpreter.GetGlobal("local-define")->Define(MakeRef<Compiled7>(interpreter));
+    interpreter.GetGlobal("use-before")->Define(MakeRef<Compiled8>(interpreter));
+    interpreter.GetGlobal("max3")->Define(MakeRef<Compiled9>(interpreter));
+    interpreter.Run("(define (make-adder n) (lambda (x) (+ x n)))");
+    interpreter.GetGlobal("apply-twice")->Define(MakeRef<Compiled10>(interpreter));
+    interpreter.GetGlobal("rename!")->Define(MakeRef<Compiled11>(interpreter));
+}
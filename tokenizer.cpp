@@ -1,37 +1,119 @@
 #include <cctype>
 #include <tokenizer.h>
 
+#include "scanner.h"
+
+// Characters of a stream, symbol names are collected in a buffer.
+class StreamReader {
+public:
+    explicit StreamReader(std::istream* in) : in_(in) {
+    }
+
+    int Peek() {
+        return in_->peek();
+    }
+
+    int Get() {
+        return in_->get();
+    }
+
+    void SkipSpace() {
+        while (std::isspace(Peek())) {
+            Get();
+        }
+    }
+
+    // symbol which starts with the character just read
+    std::string_view TakeSymbol(int first, std::string* buffer) {
+        buffer->clear();
+        *buffer += static_cast<char>(first);
+        while (IsStrContains(Peek())) {
+            *buffer += static_cast<char>(Get());
+        }
+        return *buffer;
+    }
+
+    std::string_view TakeDigits(std::string* buffer) {
+        buffer->clear();
+        while (std::isdigit(Peek())) {
+            *buffer += static_cast<char>(Get());
+        }
+        return *buffer;
+    }
+
+private:
+    std::istream* in_;
+};
+
+// Characters of a buffer, symbol names are views of it. Runs of a character class are found by
+// the vectorized scanner.
+class BufferReader {
+public:
+    BufferReader(const char** pos, const char* end) : pos_(pos), end_(end) {
+    }
+
+    int Peek() {
+        return *pos_ == end_ ? EOF : static_cast<unsigned char>(**pos_);
+    }
+
+    int Get() {
+        return *pos_ == end_ ? EOF : static_cast<unsigned char>(*(*pos_)++);
+    }
+
+    // tokens are mostly separated by a single space or none, those skip the call
+    void SkipSpace() {
+        if (std::isspace(Peek())) {
+            *pos_ = ::SkipSpace(*pos_ + 1, end_);
+        }
+    }
+
+    std::string_view TakeSymbol(int, std::string*) {
+        auto begin = *pos_ - 1;
+        *pos_ = SkipSymbolChars(*pos_, end_);
+        return std::string_view(begin, *pos_ - begin);
+    }
+
+    std::string_view TakeDigits(std::string*) {
+        auto begin = *pos_;
+        *pos_ = SkipDigits(*pos_, end_);
+        return std::string_view(begin, *pos_ - begin);
+    }
+
+private:
+    const char** pos_;
+    const char* end_;
+};
+
 Tokenizer::Tokenizer(std::istream* in) : in_(in) {
     Next();
 }
 
-bool Tokenizer::IsEnd() {
-    return is_end_;
+Tokenizer::Tokenizer(std::string_view source)
+    : pos_(source.data()), end_(source.data() + source.size()) {
+    Next();
 }
 
-inline bool IsStrBeg(char c) {
-    return std::isalpha(c) || ('<' <= c && c <= '>') || c == '*' || c == '/' || c == '#';
+bool Tokenizer::IsEnd() const {
+    return is_end_;
 }
 
-inline bool IsStrContains(char c) {
-    return IsStrBeg(c) || std::isdigit(c) || c == '?' || c == '!' || c == '-';
+void Tokenizer::Next() {
+    if (in_) {
+        Scan(StreamReader(in_));
+    } else {
+        Scan(BufferReader(&pos_, end_));
+    }
 }
 
-void Tokenizer::Next() {
-    if (in_->peek() == EOF) {
+template <class Reader>
+void Tokenizer::Scan(Reader reader) {
+    reader.SkipSpace();
+    int cur_c = reader.Get();
+    if (cur_c == EOF) {
         is_end_ = true;
         return;
     }
 
-    char cur_c = in_->get();
-    while (std::isspace(cur_c)) {
-        cur_c = in_->get();
-        if (cur_c == EOF) {
-            is_end_ = true;
-            return;
-        }
-    }
-
     if (cur_c == '(') {
         cur_ = BracketToken::OPEN;
         return;
@@ -48,35 +130,35 @@ void Tokenizer::Next() {
         cur_ = DotToken();
         return;
     }
-    if (cur_c == '#' && in_->peek() == 'f') {
-        in_->get();
+    if (cur_c == '#' && reader.Peek() == 'f') {
+        reader.Get();
         cur_ = Boolean::FALSE;
         return;
     }
-    if (cur_c == '#' && in_->peek() == 't') {
-        in_->get();
+    if (cur_c == '#' && reader.Peek() == 't') {
+        reader.Get();
         cur_ = Boolean::TRUE;
         return;
     }
 
     // makes a number out of a string
     auto read_num = [&](int& val) -> int {
-        while (std::isdigit(in_->peek())) {
+        for (char digit : reader.TakeDigits(&symbol_buffer_)) {
             val = 10 * val;
-            val += val > 0 ? in_->get() - '0' : -in_->get() + '0';
+            val += val > 0 ? digit - '0' : -digit + '0';
         }
         return val;
     };
 
     // check for number token
-    if (cur_c == '-' && std::isdigit(in_->peek())) {
-        int val = -(in_->get() - '0');
+    if (cur_c == '-' && std::isdigit(reader.Peek())) {
+        int val = -(reader.Get() - '0');
         read_num(val);
         cur_ = ConstantToken{.value = val};
         return;
     }
-    if (cur_c == '+' && std::isdigit(in_->peek())) {
-        int val = in_->get() - '0';
+    if (cur_c == '+' && std::isdigit(reader.Peek())) {
+        int val = reader.Get() - '0';
         read_num(val);
         cur_ = ConstantToken{.value = val};
         return;
@@ -88,25 +170,20 @@ void Tokenizer::Next() {
         return;
     }
     if (cur_c == '-') {
-        cur_ = SymbolToken{.name = "-"};
+        cur_ = SymbolToken("-");
         return;
     }
     if (cur_c == '+') {
-        cur_ = SymbolToken{.name = "+"};
+        cur_ = SymbolToken("+");
         return;
     }
     if (IsStrBeg(cur_c)) {
-        std::string str;
-        str += cur_c;
-        while (IsStrContains(in_->peek())) {
-            str += in_->get();
-        }
-        cur_ = SymbolToken{.name = str};
+        cur_ = SymbolToken(reader.TakeSymbol(cur_c, &symbol_buffer_));
         return;
     }
     throw SyntaxError("Unknown symbol");
 }
 
-Token Tokenizer::GetToken() {
+const Token& Tokenizer::GetToken() const {
     return cur_;
-}
\ No newline at end of file
+}
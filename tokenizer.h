@@ -3,13 +3,19 @@
 #include "error.h"
 #include <istream>
 #include <optional>
+#include <string>
+#include <string_view>
 #include <variant>
+#include "symbol_table.h"
 
 struct SymbolToken {
-    std::string name;
+    const InternedSymbol* symbol;
+
+    SymbolToken(std::string_view name) : symbol(InternSymbol(name)) {
+    }
 
     bool operator==(const SymbolToken& other) const {
-        return name == other.name;
+        return symbol == other.symbol;
     }
 };
 
@@ -39,18 +45,32 @@ struct ConstantToken {
 
 using Token = std::variant<ConstantToken, BracketToken, SymbolToken, QuoteToken, DotToken, Boolean>;
 
+// Splits source into tokens. A stream is read one character at a time, so it may grow between
+// tokens. A buffer, e.g. the content of a MappedFile, is scanned in place: symbol names are
+// interned straight from it and nothing is copied. The buffer must outlive the tokenizer.
 class Tokenizer {
 public:
     Tokenizer(std::istream* in);
 
-    bool IsEnd();
+    explicit Tokenizer(std::string_view source);
+
+    bool IsEnd() const;
 
     void Next();
 
-    Token GetToken();
+    // valid until the next call of Next
+    const Token& GetToken() const;
 
 private:
+    template <class Reader>
+    void Scan(Reader reader);
+
     bool is_end_ = false;
-    std::istream* in_;
+    std::istream* in_ = nullptr;
+    // unread part of the buffer
+    const char* pos_ = nullptr;
+    const char* end_ = nullptr;
     Token cur_;
+    // reused between tokens of a stream to avoid allocation
+    std::string symbol_buffer_;
 };
\ No newline at end of file
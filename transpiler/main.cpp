@@ -0,0 +1,38 @@
+// Command line driver of the transpiler, see transpiler.h.
+//
+//   transpiler <input.scm> <output.cpp> <register function>
+
+#include <fstream>
+#include <iostream>
+
+#include "transpiler.h"
+
+int main(int argc, char** argv) {
+    if (argc != 4) {
+        std::cerr << "usage: " << argv[0] << " <input.scm> <output.cpp> <register function>\n";
+        return 1;
+    }
+    std::ifstream input(argv[1]);
+    if (!input) {
+        std::cerr << "can't open " << argv[1] << "\n";
+        return 1;
+    }
+
+    TranspileResult result;
+    try {
+        result = Transpile(&input, argv[1], argv[3]);
+    } catch (const std::exception& error) {
+        std::cerr << argv[1] << ": " << error.what() << "\n";
+        return 1;
+    }
+
+    std::ofstream output(argv[2]);
+    output << result.code;
+    if (!output) {
+        std::cerr << "can't write " << argv[2] << "\n";
+        return 1;
+    }
+    std::cerr << result.compiled_count << " functions compiled, " << result.interpreted_count
+              << " forms left to the interpreter\n";
+    return 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// Runtime support of C++ code generated by the transpiler, see main.cpp.
+
+#include <string>
+
+#include "error.h"
+#include "object.h"
+#include "parser.h"
+#include "scheme.h"
+#include "tokenizer.h"
+
+// Quoted datum of the source, read back from its printed form.
+inline Value ReadDatum(const std::string& text) {
+    Tokenizer tokenizer(std::string_view{text});
+    return Read(&tokenizer);
+}
+
+// Calls use the fixed arity entry points, so calls of builtins build no ObjectList.
+template <class... Args>
+Value CallFunction(const Value& function, const Args&... args) {
+    if (!Is<Function>(function)) {
+        throw RuntimeError("Expression should contain operator or lambda");
+    }
+    auto callee = As<Function>(function);
+    if constexpr (sizeof...(Args) == 0) {
+        return callee->Apply0();
+    } else if constexpr (sizeof...(Args) == 1) {
+        return callee->Apply1(args...);
+    } else if constexpr (sizeof...(Args) == 2) {
+        return callee->Apply2(args...);
+    } else if constexpr (sizeof...(Args) == 3) {
+        return callee->Apply3(args...);
+    } else {
+        const Value values[] = {args...};
+        return callee->ApplySpan(values);
+    }
+}
+
+// Variables introduced by internal 'define' are unbound until the definition is executed.
+inline const Value& CheckBound(const Value& value) {
+    if (value.IsUnbound()) {
+        throw NameError("Variable is used before definition");
+    }
+    return value;
+}
+
+inline void CheckArgCount(const ObjectList& args, size_t arg_count) {
+    if (args.size() != arg_count) {
+        throw RuntimeError("Wrong number of arguments in 'Lambda' function");
+    }
+}
@@ -0,0 +1,436 @@
+#include "transpiler.h"
+
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include "analyzer.h"
+#include "parser.h"
+#include "tokenizer.h"
+
+// Thrown for forms which are left to the interpreter.
+struct Unsupported {};
+
+// names of the symbols read from input, the symbol table is not searchable by id
+static std::unordered_map<SymbolId, std::string> symbol_names;
+
+static void CollectSymbolNames(const Value& ast) {
+    if (Is<Symbol>(ast)) {
+        symbol_names.emplace(As<Symbol>(ast)->GetId(), As<Symbol>(ast)->GetName());
+    } else if (Is<Cell>(ast)) {
+        CollectSymbolNames(As<Cell>(ast)->GetFirst());
+        CollectSymbolNames(As<Cell>(ast)->GetSecond());
+    }
+}
+
+static std::string Quote(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static ObjectList GetForm(const Value& ast) {
+    try {
+        return ListToVector(ast, "");
+    } catch (const SyntaxError&) {
+        throw Unsupported();
+    }
+}
+
+// Translates one lambda to a C++ class.
+class FunctionTranspiler {
+public:
+    FunctionTranspiler(std::string class_name, SymbolId self)
+        : class_name_(std::move(class_name)), self_(self) {
+    }
+
+    std::string Translate(const Value& arg_list, const ObjectList& body, size_t body_start_ind) {
+        for (const auto& arg : GetForm(arg_list)) {
+            if (!Is<Symbol>(arg) || FindLocal(As<Symbol>(arg)->GetId()) >= 0) {
+                throw Unsupported();
+            }
+            locals_.push_back(As<Symbol>(arg)->GetId());
+        }
+        arg_count_ = locals_.size();
+        if (body_start_ind >= body.size()) {
+            throw Unsupported();
+        }
+        for (size_t i = body_start_ind; i < body.size(); ++i) {
+            CollectDefines(body[i], locals_);
+        }
+
+        indent_ = 3;
+        for (size_t i = body_start_ind; i + 1 < body.size(); ++i) {
+            Expression(body[i]);
+        }
+        Tail(body.back());
+        return MakeClass();
+    }
+
+private:
+    std::string MakeClass() const {
+        std::ostringstream out;
+        std::vector<std::string> initializers;
+        for (size_t i = 0; i < globals_.size(); ++i) {
+            initializers.push_back("g" + std::to_string(i) + "_(interpreter.GetGlobal(" +
+                                   Quote(GetSymbolName(globals_[i])) + "))");
+        }
+        for (size_t i = 0; i < constants_.size(); ++i) {
+            initializers.push_back("c" + std::to_string(i) + "_(ReadDatum(" +
+                                   Quote(constants_[i].Serialize()) + "))");
+        }
+        // unnamed if no member needs it, so that -Wunused-parameter stays quiet
+        out << "class " << class_name_ << " : public Function {\n"
+            << "public:\n"
+            << "    explicit " << class_name_
+            << (initializers.empty() ? "(Interpreter&)" : "(Interpreter& interpreter)");
+        for (size_t i = 0; i < initializers.size(); ++i) {
+            out << (i == 0 ? "\n        : " : ",\n          ") << initializers[i];
+        }
+        out << " {\n"
+            << "    }\n\n"
+            << "    std::string Serialize() override {\n"
+            << "        throw SyntaxError(\"Compiled function should not be serialized\");\n"
+            << "    }\n\n"
+            << "    Value Apply(const ObjectList& args) override {\n"
+            << "        CheckArgCount(args, " << arg_count_ << ");\n";
+        for (size_t i = 0; i < locals_.size(); ++i) {
+            out << "        Value v" << i << " = "
+                << (i < arg_count_ ? "args[" + std::to_string(i) + "]" : "Value::Unbound()")
+                << ";  // " << GetSymbolName(locals_[i]) << "\n";
+        }
+        out << "        while (true) {\n" << body_.str() << "        }\n"
+            << "    }\n";
+        if (!globals_.empty() || !constants_.empty()) {
+            out << "\nprivate:\n";
+        }
+        for (size_t i = 0; i < globals_.size(); ++i) {
+            out << "    Binding* g" << i << "_;  // " << GetSymbolName(globals_[i]) << "\n";
+        }
+        for (size_t i = 0; i < constants_.size(); ++i) {
+            out << "    Value c" << i << "_;\n";
+        }
+        out << "};\n";
+        return out.str();
+    }
+
+    static const std::string& GetSymbolName(SymbolId id) {
+        return symbol_names.at(id);
+    }
+
+    void Line(const std::string& line) {
+        body_ << std::string(4 * indent_, ' ') << line << "\n";
+    }
+
+    std::string NewTemp(const std::string& value) {
+        auto name = "t" + std::to_string(temp_count_++);
+        Line("Value " + name + " = " + value + ";");
+        return name;
+    }
+
+    int FindLocal(SymbolId name) const {
+        for (size_t i = 0; i < locals_.size(); ++i) {
+            if (locals_[i] == name) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    std::string Local(int index) const {
+        return "v" + std::to_string(index);
+    }
+
+    std::string Global(SymbolId name) {
+        size_t index = 0;
+        while (index < globals_.size() && globals_[index] != name) {
+            ++index;
+        }
+        if (index == globals_.size()) {
+            globals_.push_back(name);
+        }
+        return "g" + std::to_string(index) + "_";
+    }
+
+    std::string Constant(const Value& datum) {
+        if (!datum || Is<Number>(datum) || Is<Bool>(datum)) {
+            return Literal(datum);
+        }
+        constants_.push_back(datum);
+        return "c" + std::to_string(constants_.size() - 1) + "_";
+    }
+
+    static std::string Literal(const Value& datum) {
+        if (!datum) {
+            return "Value()";
+        }
+        if (Is<Bool>(datum)) {
+            return datum.GetBool() ? "Value::Boolean(true)" : "Value::Boolean(false)";
+        }
+        return "Value::Integer(" + std::to_string(datum.GetInteger()) + ")";
+    }
+
+    // emits statements computing the expression, returns C++ expression of its value
+    std::string Expression(const Value& ast) {
+        if (Is<Number>(ast) || Is<Bool>(ast)) {
+            return Literal(ast);
+        }
+        if (Is<Symbol>(ast)) {
+            auto name = As<Symbol>(ast)->GetId();
+            auto local = FindLocal(name);
+            if (local < 0) {
+                return NewTemp(Global(name) + "->Get()");
+            }
+            if (static_cast<size_t>(local) < arg_count_) {
+                return NewTemp(Local(local));
+            }
+            return NewTemp("CheckBound(" + Local(local) + ")");
+        }
+        if (!Is<Cell>(ast)) {
+            throw Unsupported();
+        }
+
+        auto form = GetForm(ast);
+        switch (GetSpecialForm(form.front())) {
+            case SpecialForm::kQuote:
+                if (form.size() != 2) {
+                    throw Unsupported();
+                }
+                return Constant(form[1]);
+            case SpecialForm::kIf: {
+                CheckIf(form);
+                auto result = NewTemp("Value()");
+                auto condition = Expression(form[1]);
+                Line("if (IsTrue(" + condition + ")) {");
+                ++indent_;
+                Line(result + " = " + Expression(form[2]) + ";");
+                --indent_;
+                if (form.size() == 4) {
+                    Line("} else {");
+                    ++indent_;
+                    Line(result + " = " + Expression(form[3]) + ";");
+                    --indent_;
+                }
+                Line("}");
+                return result;
+            }
+            case SpecialForm::kDefine:
+            case SpecialForm::kSet:
+                Store(form);
+                return "Value()";
+            case SpecialForm::kAnd:
+            case SpecialForm::kOr: {
+                bool is_and = GetSpecialForm(form.front()) == SpecialForm::kAnd;
+                auto result = NewTemp(is_and ? "Value::Boolean(true)" : "Value::Boolean(false)");
+                Line("do {");
+                ++indent_;
+                for (size_t i = 1; i < form.size(); ++i) {
+                    Line(result + " = " + Expression(form[i]) + ";");
+                    if (i + 1 < form.size()) {
+                        Line(std::string(is_and ? "if (!" : "if (") + "IsTrue(" + result + ")) {");
+                        Line("    break;");
+                        Line("}");
+                    }
+                }
+                --indent_;
+                Line("} while (false);");
+                return result;
+            }
+            case SpecialForm::kLambda:
+                // closures are left to the interpreter
+                throw Unsupported();
+            case SpecialForm::kNone:
+                return Call(form, false);
+        }
+        throw Unsupported();
+    }
+
+    // emits statements which return the value of expression in tail position
+    void Tail(const Value& ast) {
+        if (!Is<Cell>(ast)) {
+            Line("return " + Expression(ast) + ";");
+            return;
+        }
+        auto form = GetForm(ast);
+        switch (GetSpecialForm(form.front())) {
+            case SpecialForm::kIf:
+                CheckIf(form);
+                Line("if (IsTrue(" + Expression(form[1]) + ")) {");
+                ++indent_;
+                Tail(form[2]);
+                --indent_;
+                Line("}");
+                if (form.size() == 4) {
+                    Tail(form[3]);
+                } else {
+                    Line("return Value();");
+                }
+                return;
+            case SpecialForm::kAnd:
+            case SpecialForm::kOr: {
+                bool is_and = GetSpecialForm(form.front()) == SpecialForm::kAnd;
+                if (form.size() == 1) {
+                    Line(is_and ? "return Value::Boolean(true);" : "return Value::Boolean(false);");
+                    return;
+                }
+                for (size_t i = 1; i + 1 < form.size(); ++i) {
+                    auto value = Expression(form[i]);
+                    Line(std::string(is_and ? "if (!" : "if (") + "IsTrue(" + value + ")) {");
+                    Line("    return " + value + ";");
+                    Line("}");
+                }
+                Tail(form.back());
+                return;
+            }
+            case SpecialForm::kNone:
+                Call(form, true);
+                return;
+            default:
+                Line("return " + Expression(ast) + ";");
+                return;
+        }
+    }
+
+    static void CheckIf(const ObjectList& form) {
+        if (form.size() != 3 && form.size() != 4) {
+            throw Unsupported();
+        }
+    }
+
+    // 'define' and 'set!' of variables, all definitions in the body are local
+    void Store(const ObjectList& form) {
+        if (form.size() != 3 || !Is<Symbol>(form[1])) {
+            throw Unsupported();
+        }
+        auto name = As<Symbol>(form[1])->GetId();
+        auto value = Expression(form[2]);
+        auto local = FindLocal(name);
+        if (local >= 0) {
+            Line(Local(local) + " = " + value + ";");
+        } else {
+            Line(Global(name) + "->Set(" + value + ");");
+        }
+    }
+
+    std::string Call(const ObjectList& form, bool tail) {
+        auto function = Expression(form.front());
+        std::string args;
+        std::vector<std::string> arg_values;
+        for (size_t i = 1; i < form.size(); ++i) {
+            arg_values.push_back(Expression(form[i]));
+            args += ", " + arg_values.back();
+        }
+        auto call = "CallFunction(" + function + args + ")";
+        if (!tail) {
+            return NewTemp(call);
+        }
+
+        bool is_self = Is<Symbol>(form.front()) && As<Symbol>(form.front())->GetId() == self_ &&
+                       FindLocal(self_) < 0 && arg_values.size() == arg_count_;
+        if (is_self) {
+            // loop instead of recursion while the name is still bound to this function
+            Line("if (" + function + ".GetObject() == this) {");
+            ++indent_;
+            for (size_t i = 0; i < arg_values.size(); ++i) {
+                Line(Local(i) + " = std::move(" + arg_values[i] + ");");
+            }
+            for (size_t i = arg_count_; i < locals_.size(); ++i) {
+                Line(Local(i) + " = Value::Unbound();");
+            }
+            Line("continue;");
+            --indent_;
+            Line("}");
+        }
+        Line("return " + call + ";");
+        return "";
+    }
+
+    std::string class_name_;
+    SymbolId self_;
+    // arguments first, then variables introduced by internal 'define'
+    std::vector<SymbolId> locals_;
+    size_t arg_count_ = 0;
+    std::vector<SymbolId> globals_;
+    ObjectList constants_;
+    std::ostringstream body_;
+    int indent_ = 0;
+    size_t temp_count_ = 0;
+};
+
+// Gives name and lambda of a top level function definition, nothing for other forms.
+static bool GetFunctionDefinition(const Value& ast, Value& name, Value& arg_list, ObjectList& form,
+                                  size_t& body_start_ind) {
+    if (!Is<Cell>(ast) || GetSpecialForm(As<Cell>(ast)->GetFirst()) != SpecialForm::kDefine) {
+        return false;
+    }
+    form = GetForm(ast);
+    if (form.size() < 3) {
+        return false;
+    }
+    if (Is<Cell>(form[1])) {
+        // (define (name args...) body...)
+        name = As<Cell>(form[1])->GetFirst();
+        arg_list = As<Cell>(form[1])->GetSecond();
+        body_start_ind = 2;
+        return Is<Symbol>(name);
+    }
+    // (define name (lambda (args...) body...))
+    name = form[1];
+    if (!Is<Symbol>(name) || form.size() != 3 || !Is<Cell>(form[2]) ||
+        GetSpecialForm(As<Cell>(form[2])->GetFirst()) != SpecialForm::kLambda) {
+        return false;
+    }
+    form = GetForm(form[2]);
+    if (form.size() < 2) {
+        return false;
+    }
+    arg_list = form[1];
+    body_start_ind = 2;
+    return true;
+}
+
+TranspileResult Transpile(std::istream* input, const std::string& source_name,
+                          const std::string& register_function) {
+    std::ostringstream classes;
+    std::ostringstream registration;
+    TranspileResult result;
+    Tokenizer tokenizer(input);
+    while (!tokenizer.IsEnd()) {
+        auto ast = ReadObject(&tokenizer);
+        CollectSymbolNames(ast);
+        Value name;
+        Value arg_list;
+        ObjectList form;
+        size_t body_start_ind = 0;
+        try {
+            if (!GetFunctionDefinition(ast, name, arg_list, form, body_start_ind)) {
+                throw Unsupported();
+            }
+            auto class_name = "Compiled" + std::to_string(result.compiled_count);
+            FunctionTranspiler transpiler(class_name, As<Symbol>(name)->GetId());
+            auto code = transpiler.Translate(arg_list, form, body_start_ind);
+            classes << "// " << As<Symbol>(name)->GetName() << "\n" << code << "\n";
+            registration << "    interpreter.GetGlobal(" << Quote(As<Symbol>(name)->GetName())
+                         << ")->Define(MakeRef<" << class_name << ">(interpreter));\n";
+            ++result.compiled_count;
+        } catch (const Unsupported&) {
+            registration << "    interpreter.Run(" << Quote(ast.Serialize()) << ");\n";
+            ++result.interpreted_count;
+        }
+    }
+
+    std::ostringstream output;
+    output << "// Generated by transpiler from " << source_name << ", do not edit.\n\n"
+           << "#include \"transpiler/runtime.h\"\n\n"
+           << "namespace {\n\n"
+           << classes.str() << "}  // namespace\n\n"
+           << "void " << register_function << "(Interpreter& interpreter) {\n"
+           << registration.str() << "}\n";
+    result.code = output.str();
+    return result;
+}
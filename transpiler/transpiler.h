@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <string>
+
+// Ahead-of-time translator of Scheme definitions to C++.
+//
+// Every top level (define (name args...) body...) or (define name (lambda (args...) body...))
+// whose body creates no closures becomes a Function subclass. Its variables are C++ locals,
+// globals are resolved to bindings once and a call of itself in tail position is a loop.
+// Other top level forms are kept as source and run by the interpreter. The output defines
+//
+//   void <register function>(Interpreter& interpreter);
+//
+// which executes the forms of the input in order. It is built with the repository root on the
+// include path and linked with the interpreter sources.
+
+struct TranspileResult {
+    std::string code;
+    size_t compiled_count = 0;
+    // forms left to the interpreter
+    size_t interpreted_count = 0;
+};
+
+// Throws SyntaxError if the input can't be read, source_name goes to the header comment only.
+TranspileResult Transpile(std::istream* input, const std::string& source_name,
+                          const std::string& register_function);
@@ -0,0 +1,259 @@
+#include "vm.h"
+
+#include "optimizer.h"
+
+CompiledLambda::CompiledLambda(std::shared_ptr<CodeObject> code, Ref<Environment> env,
+                               std::shared_ptr<Scope> global)
+    : Function(ObjectType::kCompiledLambda),
+      GcNode(this),
+      code_(std::move(code)),
+      env_(std::move(env)),
+      global_(std::move(global)) {
+}
+
+std::string CompiledLambda::Serialize() {
+    throw SyntaxError("LambdaCall should not be serialized");
+}
+
+Value CompiledLambda::Apply(const ObjectList& args) {
+    return VirtualMachine(global_).Call(*this, args);
+}
+
+const std::shared_ptr<CodeObject>& CompiledLambda::GetCode() const {
+    return code_;
+}
+
+const Ref<Environment>& CompiledLambda::GetEnvironment() const {
+    return env_;
+}
+
+void CompiledLambda::Trace(std::vector<GcNode*>& children) {
+    if (env_) {
+        children.push_back(env_.Get());
+    }
+}
+
+void CompiledLambda::Clear() {
+    env_ = nullptr;
+}
+
+VirtualMachine::VirtualMachine(std::shared_ptr<Scope> global) : global_(std::move(global)) {
+}
+
+Value VirtualMachine::Run(const std::shared_ptr<CodeObject>& code) {
+    frames_.clear();
+    stack_.clear();
+    frames_.push_back(CallFrame{.code = code, .ip = 0, .env = nullptr, .base = 0});
+    return Execute();
+}
+
+Value VirtualMachine::Call(const CompiledLambda& function, const ObjectList& args) {
+    frames_.clear();
+    stack_.assign(args.begin(), args.end());
+    auto env = MakeCallEnvironment(function, args.size());
+    frames_.push_back(CallFrame{.code = function.GetCode(), .ip = 0, .env = env, .base = 0});
+    return Execute();
+}
+
+Ref<Environment> VirtualMachine::MakeCallEnvironment(const CompiledLambda& function,
+                                                                 size_t argc) {
+    const auto& code = function.GetCode();
+    if (argc != code->arg_count) {
+        throw RuntimeError("Wrong number of arguments in 'Lambda' function");
+    }
+    auto env = Environment::Make(code->local_count, function.GetEnvironment());
+    for (size_t i = 0; i < argc; ++i) {
+        env->Slot(0, i) = std::move(stack_[stack_.size() - argc + i]);
+    }
+    stack_.resize(stack_.size() - argc);
+    return env;
+}
+
+Value VirtualMachine::Execute() {
+    // computed goto dispatch, order must match Opcode
+    static const void* kDispatchTable[] = {
+        &&push_const,      &&push_nil,          &&push_folded,       &&load_local,
+        &&store_local,     &&load_global,       &&define_global,     &&set_global,
+        &&make_closure,    &&call,              &&tail_call,         &&jump,
+        &&jump_if_false,   &&jump_if_false_keep, &&jump_if_true_keep, &&pop,
+        &&ret};
+    static_assert(std::size(kDispatchTable) == static_cast<size_t>(Opcode::kOpcodeCount));
+
+    const CodeObject* code = frames_.back().code.get();
+    const int32_t* ip = code->code.data() + frames_.back().ip;
+
+#define DISPATCH() goto* kDispatchTable[*ip++]
+#define LOAD_FRAME()                                         \
+    do {                                                     \
+        code = frames_.back().code.get();                    \
+        ip = code->code.data() + frames_.back().ip;          \
+    } while (false)
+
+    DISPATCH();
+
+push_const:
+    stack_.push_back(code->constants[*ip++]);
+    DISPATCH();
+
+push_nil:
+    stack_.push_back(Value());
+    DISPATCH();
+
+push_folded : {
+    auto folded = static_cast<FoldedCall*>(code->constants[ip[0]].GetObject());
+    if (folded->IsValid()) {
+        stack_.push_back(folded->GetValue());
+        ip = code->code.data() + ip[1];
+    } else {
+        ip += 2;
+    }
+    DISPATCH();
+}
+
+load_local : {
+    const auto& value = frames_.back().env->Slot(ip[0], ip[1]);
+    if (value.IsUnbound()) {
+        throw NameError("Variable is used before definition");
+    }
+    stack_.push_back(value);
+    ip += 2;
+    DISPATCH();
+}
+
+store_local:
+    frames_.back().env->Slot(ip[0], ip[1]) = std::move(stack_.back());
+    stack_.pop_back();
+    ip += 2;
+    DISPATCH();
+
+load_global:
+    stack_.push_back(code->bindings[*ip++]->Get());
+    DISPATCH();
+
+define_global:
+    code->bindings[*ip++]->Define(std::move(stack_.back()));
+    stack_.pop_back();
+    DISPATCH();
+
+set_global:
+    code->bindings[*ip++]->Set(std::move(stack_.back()));
+    stack_.pop_back();
+    DISPATCH();
+
+make_closure:
+    stack_.push_back(
+        MakeRef<CompiledLambda>(code->functions[*ip++], frames_.back().env, global_));
+    DISPATCH();
+
+call:
+tail_call : {
+    bool is_tail = ip[-1] == static_cast<int32_t>(Opcode::kTailCall);
+    size_t argc = *ip++;
+    frames_.back().ip = ip - code->code.data();
+    // computed goto leaves a block without running destructors, so the call keeps its locals in
+    // a function of its own
+    CallFunction(argc, is_tail);
+    LOAD_FRAME();
+    DISPATCH();
+}
+
+jump:
+    ip = code->code.data() + *ip;
+    DISPATCH();
+
+jump_if_false:
+    if (!IsTrue(stack_.back())) {
+        ip = code->code.data() + *ip;
+    } else {
+        ++ip;
+    }
+    stack_.pop_back();
+    DISPATCH();
+
+jump_if_false_keep:
+    if (!IsTrue(stack_.back())) {
+        ip = code->code.data() + *ip;
+    } else {
+        stack_.pop_back();
+        ++ip;
+    }
+    DISPATCH();
+
+jump_if_true_keep:
+    if (IsTrue(stack_.back())) {
+        ip = code->code.data() + *ip;
+    } else {
+        stack_.pop_back();
+        ++ip;
+    }
+    DISPATCH();
+
+pop:
+    stack_.pop_back();
+    DISPATCH();
+
+ret : {
+    auto result = std::move(stack_.back());
+    stack_.resize(frames_.back().base);
+    Environment::Recycle(frames_.back().env);
+    frames_.pop_back();
+    if (frames_.empty()) {
+        return result;
+    }
+    stack_.push_back(std::move(result));
+    LOAD_FRAME();
+    DISPATCH();
+}
+
+#undef LOAD_FRAME
+#undef DISPATCH
+}
+
+void VirtualMachine::CallFunction(size_t argc, bool is_tail) {
+    auto function = stack_[stack_.size() - argc - 1];
+
+    if (Is<CompiledLambda>(function)) {
+        auto lambda = As<CompiledLambda>(function);
+        auto env = MakeCallEnvironment(*lambda, argc);
+        stack_.pop_back();
+        if (is_tail) {
+            // reuse current frame, its temporaries are not needed anymore
+            auto& frame = frames_.back();
+            stack_.resize(frame.base);
+            frame.code = lambda->GetCode();
+            frame.ip = 0;
+            Environment::Recycle(frame.env);
+            frame.env = std::move(env);
+        } else {
+            frames_.push_back(CallFrame{
+                .code = lambda->GetCode(), .ip = 0, .env = std::move(env), .base = stack_.size()});
+        }
+        return;
+    }
+
+    if (!Is<Function>(function)) {
+        throw RuntimeError("Expression should contain operator or lambda");
+    }
+    // builtins read their arguments in place, callees which run Scheme code copy them first
+    auto callee = As<Function>(function);
+    const Value* args = stack_.data() + stack_.size() - argc;
+    Value result;
+    switch (argc) {
+        case 0:
+            result = callee->Apply0();
+            break;
+        case 1:
+            result = callee->Apply1(args[0]);
+            break;
+        case 2:
+            result = callee->Apply2(args[0], args[1]);
+            break;
+        case 3:
+            result = callee->Apply3(args[0], args[1], args[2]);
+            break;
+        default:
+            result = callee->ApplySpan(ArgSpan(args, argc));
+    }
+    stack_.resize(stack_.size() - argc - 1);
+    stack_.push_back(std::move(result));
+}
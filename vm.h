@@ -0,0 +1,69 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "compiler.h"
+#include "object.h"
+
+class CompiledLambda : public Function, public GcNode {
+public:
+    CompiledLambda(std::shared_ptr<CodeObject> code, Ref<Environment> env,
+                   std::shared_ptr<Scope> global);
+
+    std::string Serialize() override;
+
+    Value Apply(const ObjectList& args) override;
+
+    static bool Classof(ObjectType type) {
+        return type == ObjectType::kCompiledLambda;
+    }
+
+    const std::shared_ptr<CodeObject>& GetCode() const;
+
+    const Ref<Environment>& GetEnvironment() const;
+
+    GcNode* GetGcNode() override {
+        return this;
+    }
+
+    void Trace(std::vector<GcNode*>& children) override;
+
+    void Clear() override;
+
+private:
+    std::shared_ptr<CodeObject> code_;
+    Ref<Environment> env_;
+    std::shared_ptr<Scope> global_;
+};
+
+class VirtualMachine {
+public:
+    VirtualMachine(std::shared_ptr<Scope> global);
+
+    // runs top level code
+    Value Run(const std::shared_ptr<CodeObject>& code);
+
+    Value Call(const CompiledLambda& function, const ObjectList& args);
+
+private:
+    struct CallFrame {
+        std::shared_ptr<CodeObject> code;
+        size_t ip;
+        Ref<Environment> env;
+        // stack size at the moment of call
+        size_t base;
+    };
+
+    Value Execute();
+
+    // calls the function below argc arguments on the stack, a compiled lambda gets a new frame
+    // or replaces the current one in tail position
+    void CallFunction(size_t argc, bool is_tail);
+
+    Ref<Environment> MakeCallEnvironment(const CompiledLambda& function, size_t argc);
+
+    std::vector<CallFrame> frames_;
+    ObjectList stack_;
+    std::shared_ptr<Scope> global_;
+};